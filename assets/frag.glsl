@@ -20,19 +20,34 @@
 #define ANTIALIASING_SAMPLES 1
 #define BACKGROUND_COLOR vec3(0.6,0.8,1.0)
 #define COL col_scene
+#define CONE_PREPASS 0
 #define DE de_scene
+#define DEPTH_SCALE 256.0
 #define DIFFUSE_ENABLED 0
 #define DIFFUSE_ENHANCED_ENABLED 1
 #define FOCAL_DIST 1.73205080757
 #define FOG_ENABLED 0
+#define FRAC_ANG1_COS cos(iFracAng1)
+#define FRAC_ANG1_SIN sin(iFracAng1)
+#define FRAC_ANG2_COS cos(iFracAng2)
+#define FRAC_ANG2_SIN sin(iFracAng2)
+#define FRAC_COL iFracCol
+#define FRAC_SCALE iFracScale
+#define FRAC_SHIFT iFracShift
 #define LIGHT_COLOR vec3(1.0,0.95,0.8)
 #define LIGHT_DIRECTION vec3(-0.36, 0.8, 0.48)
 #define MAX_DIST 30.0
 #define MAX_MARCHES 1000
 #define MIN_DIST 1e-5
 #define PI 3.14159265358979
+#define SCENE_BLOCK 0
 #define SHADOWS_ENABLED 1
 #define SHADOW_DARKNESS 0.7
+#define SHADOW_DEPTH_FALLOFF 10.0
+#define SHADOW_MAX_DIST 15.0
+#define SHADOW_MAX_MARCHES 200
+#define SHADOW_PASS 0
+#define SHADOW_SECONDARY_MARCHES 48
 #define SHADOW_SHARPNESS 10.0
 #define SPECULAR_HIGHLIGHT 40
 #define SPECULAR_MULT 0.25
@@ -41,10 +56,36 @@
 #define SUN_SIZE 0.004
 #define VIGNETTE_STRENGTH 0.5
 
-uniform mat4 iMat;
 uniform vec2 iResolution;
 uniform vec3 iDebug;
+uniform vec2 iJitter;
+uniform float iTemporal;
+uniform sampler2D iConeDepth;
+uniform vec2 iConeSize;
+uniform float iConeTile;
+uniform sampler2D iShadowBuf;
+uniform vec2 iShadowSize;
+uniform vec2 iShadowRes;
+uniform float iShadowTile;
 
+#if SCENE_BLOCK
+//The GL 3.3 backend fills these from one buffer, only when they change.
+//The layout has to match SceneBlock in GL3Backend.cpp.
+layout(std140) uniform SceneBlock {
+  mat4 iMat;
+  vec3 iMarblePos;
+  float iMarbleRad;
+  vec3 iFlagPos;
+  float iFlagScale;
+  vec3 iFracShift;
+  float iFracScale;
+  vec3 iFracCol;
+  float iFracAng1;
+  float iFracAng2;
+  float iExposure;
+};
+#else
+uniform mat4 iMat;
 uniform float iFracScale;
 uniform float iFracAng1;
 uniform float iFracAng2;
@@ -55,6 +96,7 @@ uniform float iMarbleRad;
 uniform float iFlagScale;
 uniform vec3 iFlagPos;
 uniform float iExposure;
+#endif
 
 vec3 refraction(vec3 rd, vec3 n, float p) {
   float dot_nd = dot(rd, n);
@@ -128,27 +170,37 @@ float de_capsule(vec4 p, float h, float r) {
 //##########################################
 //   Main DEs
 //##########################################
+//The FRAC_ defines read the fractal uniforms, unless a level's shader was
+//compiled with its constants baked in. Either way the trig is done once.
 float de_fractal(vec4 p) {
+  float s1 = FRAC_ANG1_SIN;
+  float c1 = FRAC_ANG1_COS;
+  float s2 = FRAC_ANG2_SIN;
+  float c2 = FRAC_ANG2_COS;
   for (int i = 0; i < 16; ++i) {
     p.xyz = abs(p.xyz);
-    rotZ(p, iFracAng1);
+    rotZ(p, s1, c1);
     mengerFold(p);
-    rotX(p, iFracAng2);
-    p *= iFracScale;
-    p.xyz += iFracShift;
+    rotX(p, s2, c2);
+    p *= FRAC_SCALE;
+    p.xyz += FRAC_SHIFT;
   }
   return de_box(p, vec3(6.0));
 }
 vec4 col_fractal(vec4 p) {
+  float s1 = FRAC_ANG1_SIN;
+  float c1 = FRAC_ANG1_COS;
+  float s2 = FRAC_ANG2_SIN;
+  float c2 = FRAC_ANG2_COS;
   vec3 orbit = vec3(0.0);
   for (int i = 0; i < 16; ++i) {
     p.xyz = abs(p.xyz);
-    rotZ(p, iFracAng1);
+    rotZ(p, s1, c1);
     mengerFold(p);
-    rotX(p, iFracAng2);
-    p *= iFracScale;
-    p.xyz += iFracShift;
-    orbit = max(orbit, p.xyz*iFracCol);
+    rotX(p, s2, c2);
+    p *= FRAC_SCALE;
+    p.xyz += FRAC_SHIFT;
+    orbit = max(orbit, p.xyz*FRAC_COL);
   }
   return vec4(orbit, de_box(p, vec3(6.0)));
 }
@@ -194,15 +246,16 @@ vec4 col_scene(vec4 p) {
 //##########################################
 //   Main code
 //##########################################
-vec4 ray_march(inout vec4 p, vec4 ray, float sharpness) {
-	//March the ray
+vec4 ray_march(inout vec4 p, vec4 ray, float sharpness, vec2 start) {
+	//March the ray, skipping the distance known to be empty
+	p += ray * start.x;
 	float d = DE(p);
 	if (d < 0.0 && sharpness == 1.0) {
 		vec3 v = iMarblePos.xyz - iMat[3].xyz;
 		d = dot(v, v) / dot(v, ray.xyz) - iMarbleRad;
 	}
-	float s = 0.0;
-	float td = 0.0;
+	float s = start.y;
+	float td = start.x;
 	float min_d = 1.0;
 	for (; s < MAX_MARCHES; s += 1.0) {
 		if (d < MIN_DIST) {
@@ -219,9 +272,70 @@ vec4 ray_march(inout vec4 p, vec4 ray, float sharpness) {
 	return vec4(d, s, td, min_d);
 }
 
-vec4 scene(inout vec4 p, inout vec4 ray, float vignette) {
+//Soft shadow toward the light. Running out of steps counts as reaching it.
+float soft_shadow(vec4 p, float max_steps, float max_dist) {
+	float d = DE(p);
+	float td = 0.0;
+	float min_d = 1.0;
+	for (float s = 0.0; s < max_steps; s += 1.0) {
+		if (d < MIN_DIST || td > max_dist) {
+			break;
+		}
+		td += d;
+		p.xyz += LIGHT_DIRECTION * d;
+		min_d = min(min_d, SHADOW_SHARPNESS * d / td);
+		d = DE(p);
+	}
+	if (d >= MIN_DIST) {
+		td = max(td, 1.0);
+	}
+	return min_d * min(td, 1.0);
+}
+
+//Shadow buffer depth, 16 bits in two channels on the same log scale as alpha
+vec2 pack_shadow_depth(float td) {
+	float v = log2(td*DEPTH_SCALE + 1.0) / log2(MAX_DIST*DEPTH_SCALE + 1.0);
+	v = clamp(v, 0.0, 1.0) * 255.0;
+	return vec2(floor(v) / 255.0, fract(v));
+}
+float unpack_shadow_depth(vec2 c) {
+	float v = c.x + c.y / 255.0;
+	return (exp2(v * log2(MAX_DIST*DEPTH_SCALE + 1.0)) - 1.0) / DEPTH_SCALE;
+}
+
+//Bilinear over the 4 nearest shadow texels, leaving out the ones that saw a
+//surface at a different depth so shadows don't bleed across edges
+float upsample_shadow(float td) {
+	vec2 sp = gl_FragCoord.xy / iShadowTile - 0.5;
+	vec2 base = floor(sp);
+	vec2 f = sp - base;
+	float sum = 0.0;
+	float w_sum = 0.0;
+	float best_dt = 1e9;
+	float best_k = 1.0;
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < 2; ++j) {
+			vec2 tp = clamp(base + vec2(i, j) + 0.5, vec2(0.5), iShadowRes - 0.5);
+			vec4 c = texture2D(iShadowBuf, tp / iShadowSize);
+			float dt = abs(unpack_shadow_depth(c.gb) - td) / td;
+			vec2 b = mix(1.0 - f, f, vec2(i, j));
+			float w = b.x * b.y * max(1.0 - dt * SHADOW_DEPTH_FALLOFF, 0.0);
+			sum += c.r * w;
+			w_sum += w;
+			if (dt < best_dt) {
+				best_dt = dt;
+				best_k = c.r;
+			}
+		}
+	}
+	return w_sum > 1e-4 ? sum / w_sum : best_k;
+}
+
+//Shadows are marched with shadow_steps, or read from the buffer if it is 0.
+//Marches capped below MAX_MARCHES also stop at SHADOW_MAX_DIST.
+vec4 scene(inout vec4 p, inout vec4 ray, float vignette, vec2 start, float shadow_steps) {
 	//Trace the ray
-	vec4 d_s_td_m = ray_march(p, ray, 1.0f);
+	vec4 d_s_td_m = ray_march(p, ray, 1.0f, start);
 	float d = d_s_td_m.x;
 	float s = d_s_td_m.y;
 	float td = d_s_td_m.z;
@@ -245,10 +359,13 @@ vec4 scene(inout vec4 p, inout vec4 ray, float vignette) {
 		//Get if this point is in shadow
 		float k = 1.0;
 		#if SHADOWS_ENABLED
-			vec4 light_pt = p;
-			light_pt.xyz += n * MIN_DIST * 100;
-			vec4 rm = ray_march(light_pt, vec4(LIGHT_DIRECTION, 0.0), SHADOW_SHARPNESS);
-      k = rm.w * min(rm.z, 1.0);
+			if (shadow_steps > 0.0) {
+				vec4 light_pt = p;
+				light_pt.xyz += n * MIN_DIST * 100;
+				k = soft_shadow(light_pt, shadow_steps, shadow_steps < MAX_MARCHES ? SHADOW_MAX_DIST : MAX_DIST);
+			} else {
+				k = upsample_shadow(td);
+			}
 		#endif
 
 		//Get specular
@@ -297,13 +414,97 @@ vec4 scene(inout vec4 p, inout vec4 ray, float vignette) {
 	return col;
 }
 
+//##########################################
+//   Cone prepass
+//##########################################
+//Start distance packed into 24 bits of RGB, rounded down so it never moves
+//past a surface, and the steps it took in alpha to keep occlusion the same
+vec4 pack_start(float td, float s) {
+	float v = clamp(td / (2.0 * MAX_DIST), 0.0, 1.0) * 255.0;
+	float r = floor(v);
+	v = (v - r) * 255.0;
+	float g = floor(v);
+	float b = floor((v - g) * 255.0);
+	return vec4(vec3(r, g, b) / 255.0, min(s / 1020.0, 1.0));
+}
+vec2 unpack_start(vec4 c) {
+	float v = dot(c.rgb, vec3(1.0, 1.0 / 255.0, 1.0 / 65025.0));
+	return vec2(v * (2.0 * MAX_DIST) * 0.9999, c.a * 1020.0);
+}
+
+#if CONE_PREPASS
+//One cone per tile of iConeTile x iConeTile pixels. Each step is shortened by
+//the cone radius at its far end, so the ball of radius DE around the center
+//ray covers every ray in the cone, and all of them can start where it stops.
+void main() {
+	vec2 screen_pos = gl_FragCoord.xy * iConeTile / iResolution.xy;
+	vec2 uv = 2*screen_pos - 1;
+	uv.x *= iResolution.x / iResolution.y;
+	vec4 ray = iMat * normalize(vec4(uv.x, uv.y, -FOCAL_DIST, 0.0));
+	vec4 p = iMat[3];
+
+	//Half the tile diagonal plus room for jitter and supersampling offsets
+	float slope = (iConeTile * 0.5 + 1.0) * 1.41421356 * 2.0 / (iResolution.y * FOCAL_DIST);
+	float td = 0.0;
+	float s = 0.0;
+	for (; s < MAX_MARCHES; s += 1.0) {
+		float d = DE(p);
+		float r = slope * (td + d);
+		if (d <= r || td > MAX_DIST) {
+			break;
+		}
+		td += d - r;
+		p += ray * (d - r);
+	}
+	gl_FragColor = pack_start(td, s);
+}
+#elif SHADOW_PASS
+//Shadow factor for the primary hit of every iShadowTile x iShadowTile block of
+//pixels, with fewer steps and a shorter reach than the full shadow march
+void main() {
+	vec2 pix = gl_FragCoord.xy * iShadowTile;
+	vec2 uv = 2*pix / iResolution.xy - 1;
+	uv.x *= iResolution.x / iResolution.y;
+	vec4 ray = iMat * normalize(vec4(uv.x, uv.y, -FOCAL_DIST, 0.0));
+	vec4 p = iMat[3];
+
+	vec2 start = vec2(0.0);
+	if (iConeTile > 0.0) {
+		vec2 tile = floor(pix / iConeTile) + 0.5;
+		start = unpack_start(texture2D(iConeDepth, tile / iConeSize));
+	}
+	vec4 d_s_td_m = ray_march(p, ray, 1.0, start);
+
+	float k = 1.0;
+	float td = MAX_DIST;
+	if (d_s_td_m.x < MIN_DIST) {
+		vec4 e = vec4(MIN_DIST, 0.0, 0.0, 0.0);
+		vec3 n = normalize(vec3(DE(p + e.xyyy) - DE(p - e.xyyy),
+		                        DE(p + e.yxyy) - DE(p - e.yxyy),
+		                        DE(p + e.yyxy) - DE(p - e.yyxy)));
+		vec4 light_pt = p;
+		light_pt.xyz += n * MIN_DIST * 100;
+		k = soft_shadow(light_pt, float(SHADOW_MAX_MARCHES), SHADOW_MAX_DIST);
+		td = length(p.xyz - iMat[3].xyz);
+	}
+	gl_FragColor = vec4(k, pack_shadow_depth(td), 1.0);
+}
+#else
 void main() {
 	vec3 col = vec3(0.0);
+	float depth = 1.0;
+
+	//Where the prepass found the first surface near this pixel
+	vec2 start = vec2(0.0);
+	if (iConeTile > 0.0) {
+		vec2 tile = floor(gl_FragCoord.xy / iConeTile) + 0.5;
+		start = unpack_start(texture2D(iConeDepth, tile / iConeSize));
+	}
 	for (int i = 0; i < ANTIALIASING_SAMPLES; ++i) {
 		for (int j = 0; j < ANTIALIASING_SAMPLES; ++j) {
 			//Get normalized screen coordinate
       vec2 delta = vec2(i, j) / ANTIALIASING_SAMPLES;
-			vec2 screen_pos = (gl_FragCoord.xy + delta) / iResolution.xy;
+			vec2 screen_pos = (gl_FragCoord.xy + delta + iJitter) / iResolution.xy;
 			vec2 uv = 2*screen_pos - 1;
 			uv.x *= iResolution.x / iResolution.y;
 
@@ -314,7 +515,15 @@ void main() {
 			//Reflect light if needed
 			float vignette = 1.0 - VIGNETTE_STRENGTH * length(screen_pos - 0.5);
       vec3 r = ray.xyz;
-      vec4 col_r = scene(p, ray, vignette);
+      vec4 col_r = scene(p, ray, vignette, start, iShadowTile > 0.0 ? 0.0 : float(MAX_MARCHES));
+
+      //Keep the hit distance for temporal reprojection, log scale for 8 bits
+      if (i == 0 && j == 0) {
+        float td = length(p.xyz - iMat[3].xyz);
+        if (td < MAX_DIST) {
+          depth = log2(td*DEPTH_SCALE + 1.0) / log2(MAX_DIST*DEPTH_SCALE + 1.0);
+        }
+      }
 
       //Check if this is the glass marble
       if (col_r.w > 0.5) {
@@ -326,14 +535,14 @@ void main() {
         q = (dot(q, r) * 2.0) * q - r;
         vec4 p_temp = vec4(p2 + n * (MIN_DIST * 10), 1.0);
         vec4 r_temp = vec4(q, 0.0);
-        vec3 refr = scene(p_temp, r_temp, 0.8).xyz;
+        vec3 refr = scene(p_temp, r_temp, 0.8, vec2(0.0), float(SHADOW_SECONDARY_MARCHES)).xyz;
 
         //Calculate refraction
         n = normalize(p.xyz - iMarblePos);
         q = r - n*(2*dot(r,n));
         p_temp = vec4(p.xyz + n * (MIN_DIST * 10), 1.0);
         r_temp = vec4(q, 0.0);
-        vec3 refl = scene(p_temp, r_temp, 0.8).xyz;
+        vec3 refl = scene(p_temp, r_temp, 0.8, vec2(0.0), float(SHADOW_SECONDARY_MARCHES)).xyz;
 
         //Combine for final marble color
         col += refr * 0.6f + refl * 0.4f + col_r.xyz;
@@ -344,5 +553,6 @@ void main() {
 	}
 
 	col *= iExposure / (ANTIALIASING_SAMPLES * ANTIALIASING_SAMPLES);
-  gl_FragColor = vec4(clamp(col, 0.0, 1.0), 1.0);
+  gl_FragColor = vec4(clamp(col, 0.0, 1.0), mix(1.0, depth, iTemporal));
 }
+#endif
@@ -0,0 +1,97 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#version 120
+//Must match frag.glsl
+#define DEPTH_SCALE 256.0
+#define FOCAL_DIST 1.73205080757
+#define MAX_DIST 30.0
+
+#define DEPTH_TOLERANCE 0.1
+
+uniform sampler2D iCurrent;   //Jittered frame, hit distance in alpha
+uniform sampler2D iHistory;   //Previous result, hit distance in alpha
+uniform vec2 iTextureSize;    //Full size of both textures
+uniform vec2 iResolution;     //Pixels of the textures that hold the frame
+uniform mat4 iMat;            //Camera of the current frame
+uniform mat4 iPrevMat;        //Camera of the previous frame
+uniform float iHistoryWeight; //0 when there is no usable history at all
+
+float decode_depth(float a) {
+  return (exp2(a * log2(MAX_DIST*DEPTH_SCALE + 1.0)) - 1.0) / DEPTH_SCALE;
+}
+
+vec4 tap(vec2 pix) {
+  pix = clamp(pix, vec2(0.5), iResolution - 0.5);
+  return texture2D(iCurrent, pix / iTextureSize);
+}
+
+void main() {
+  vec2 pix = gl_FragCoord.xy;
+  vec4 cur = tap(pix);
+
+  //Color range around this pixel, history outside of it is out of date
+  vec3 col_min = cur.rgb;
+  vec3 col_max = cur.rgb;
+  for (int i = -1; i <= 1; ++i) {
+    for (int j = -1; j <= 1; ++j) {
+      vec3 c = tap(pix + vec2(i, j)).rgb;
+      col_min = min(col_min, c);
+      col_max = max(col_max, c);
+    }
+  }
+
+  //Reproject from the pixel center and not the jittered sample, otherwise a
+  //still camera would shift the history by the jitter every frame
+  vec2 uv = 2.0*pix / iResolution - 1.0;
+  uv.x *= iResolution.x / iResolution.y;
+  vec3 ray = (iMat * normalize(vec4(uv.x, uv.y, -FOCAL_DIST, 0.0))).xyz;
+
+  //Move the hit point into the previous camera, the sky only rotates
+  bool sky = cur.a > 0.999;
+  vec3 q = sky ? ray : iMat[3].xyz + ray*decode_depth(cur.a) - iPrevMat[3].xyz;
+  q = transpose(mat3(iPrevMat)) * q;
+
+  //Project it back onto the previous frame
+  float weight = iHistoryWeight;
+  if (q.z > -1e-6) {
+    weight = 0.0;
+  }
+  vec2 prev_uv = q.xy * (-FOCAL_DIST / min(q.z, -1e-6));
+  prev_uv.x *= iResolution.y / iResolution.x;
+  vec2 prev_pix = (prev_uv*0.5 + 0.5) * iResolution;
+  if (any(lessThan(prev_pix, vec2(0.0))) || any(greaterThan(prev_pix, iResolution))) {
+    weight = 0.0;
+  }
+
+  //The previous frame must have seen the same surface there, check the depth
+  //of the nearest pixel since filtering depth across an edge means nothing
+  float prev_a = texture2D(iHistory, (floor(prev_pix) + 0.5) / iTextureSize).a;
+  if (sky) {
+    if (prev_a < 0.999) {
+      weight = 0.0;
+    }
+  } else {
+    float dist = length(q);
+    if (abs(decode_depth(prev_a) - dist) > DEPTH_TOLERANCE * dist) {
+      weight = 0.0;
+    }
+  }
+
+  vec3 hist = texture2D(iHistory, prev_pix / iTextureSize).rgb;
+  hist = clamp(hist, col_min, col_max);
+  gl_FragColor = vec4(mix(cur.rgb, hist, weight), cur.a);
+}
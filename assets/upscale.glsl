@@ -0,0 +1,49 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#version 120
+uniform sampler2D iSource;
+uniform vec2 iSourceSize;  //Pixels of the texture that hold the current frame
+uniform vec2 iTextureSize; //Full size of the texture
+uniform float iSharpness;  //0 for plain bilinear
+
+//Bilinear upscale of the rendered corner of the fractal texture, followed by an
+//unsharp mask that is clamped to the neighborhood so edges get steeper without
+//ringing. Neighbors are one source pixel away, so the filter follows the
+//source resolution and not the window.
+vec2 px_lo;
+vec2 px_hi;
+vec3 tap(vec2 uv) {
+  return texture2D(iSource, clamp(uv, px_lo, px_hi)).rgb;
+}
+
+void main() {
+  vec2 px = 1.0 / iTextureSize;
+  px_lo = 0.5 * px;
+  px_hi = (iSourceSize - 0.5) * px;
+
+  vec2 uv = gl_TexCoord[0].xy;
+  vec3 c = tap(uv);
+  vec3 n = tap(uv + vec2(0.0, px.y));
+  vec3 s = tap(uv - vec2(0.0, px.y));
+  vec3 e = tap(uv + vec2(px.x, 0.0));
+  vec3 w = tap(uv - vec2(px.x, 0.0));
+
+  vec3 col_min = min(c, min(min(n, s), min(e, w)));
+  vec3 col_max = max(c, max(max(n, s), max(e, w)));
+  vec3 col = c + (4.0*c - n - s - e - w) * (0.25 * iSharpness);
+  gl_FragColor = vec4(clamp(col, col_min, col_max), 1.0);
+}
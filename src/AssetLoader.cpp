@@ -0,0 +1,89 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "AssetLoader.h"
+#include <iostream>
+
+#ifdef NDEBUG
+static const bool log_load_times = false;
+#else
+static const bool log_load_times = true;
+#endif
+
+AssetLoader asset_loader;
+
+AssetLoader::AssetLoader() : quit(false) {
+}
+
+AssetLoader::~AssetLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
+std::shared_future<bool> AssetLoader::Load(const std::string& name, const Job& job) {
+  Task task;
+  task.name = name;
+  task.job = job;
+  std::shared_future<bool> result = task.done.get_future().share();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  queue.push_back(std::move(task));
+  if (workers.size() < (size_t)asset_threads && workers.size() < queue.size()) {
+    workers.push_back(std::thread(&AssetLoader::Run, this));
+  }
+  wake.notify_one();
+  return result;
+}
+
+void AssetLoader::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    //Anything still queued on exit is finished so no one waits forever
+    wake.wait(lock, [this] { return quit || !queue.empty(); });
+    if (queue.empty()) { return; }
+    Task task = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool ok = task.job();
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    //Failures are always reported, a sound that failed to load just stays silent
+    lock.lock();
+    if (!ok) {
+      std::cerr << "Failed to load " << task.name << " in " << int(ms + 0.5) << " ms" << std::endl;
+    } else if (log_load_times) {
+      std::cout << "Loaded " << task.name << " in " << int(ms + 0.5) << " ms" << std::endl;
+    }
+    task.done.set_value(ok);
+  }
+}
+
+void AsyncSound::play() {
+  if (!bound) {
+    if (!buffer.IsReady() || !buffer.Wait()) { return; }
+    sound.setBuffer(buffer.Get());
+    bound = true;
+  }
+  sound.play();
+}
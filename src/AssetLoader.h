@@ -0,0 +1,121 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Res.h"
+#include <SFML/Audio.hpp>
+#include <SFML/Graphics.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int asset_threads = 4; //Loads in flight at once, the disk is the bottleneck rather than the CPU
+
+//Reads and decodes assets on a few background threads so the resolution
+//picker and the intro don't wait for every sound to load. Failed loads are
+//reported, and builds without NDEBUG also report how long each load took.
+class AssetLoader {
+public:
+  typedef std::function<bool()> Job;
+
+  AssetLoader();
+  ~AssetLoader();
+
+  //Queues the job, the future holds whether it succeeded
+  std::shared_future<bool> Load(const std::string& name, const Job& job);
+
+protected:
+  void Run();
+
+private:
+  struct Task {
+    std::string name;
+    Job job;
+    std::promise<bool> done;
+  };
+
+  std::deque<Task>         queue;
+  std::vector<std::thread> workers;
+  std::mutex               mutex;
+  std::condition_variable  wake;
+  bool                     quit;
+};
+extern AssetLoader asset_loader;
+
+//Packed assets load from the mapped pack without opening anything, fonts and
+//streams keep reading from it. Others fall back to their loose files.
+inline bool LoadAsset(sf::Music& music, const std::string& path) {
+  const Res res = GetRes(path.c_str());
+  return (res.ptr ? music.openFromMemory(res.ptr, res.size) : music.openFromFile(path));
+}
+template<typename T> bool LoadAsset(T& asset, const std::string& path) {
+  const Res res = GetRes(path.c_str());
+  return (res.ptr ? asset.loadFromMemory(res.ptr, res.size) : asset.loadFromFile(path));
+}
+
+//An asset that loads in the background. It must not be touched until Wait()
+//or IsReady() says it is done, and it waits for the load when destroyed.
+//The queued load writes to this object, so it can't be copied or moved.
+template<typename T>
+class AsyncAsset {
+public:
+  AsyncAsset() {}
+  explicit AsyncAsset(const char* path) { Load(path); }
+  ~AsyncAsset() { if (loaded.valid()) { loaded.wait(); } }
+  AsyncAsset(const AsyncAsset&) = delete;
+  AsyncAsset(AsyncAsset&&) = delete;
+  AsyncAsset& operator=(const AsyncAsset&) = delete;
+  AsyncAsset& operator=(AsyncAsset&&) = delete;
+
+  void Load(const char* path) {
+    T* a = &asset;
+    const std::string p(path);
+    loaded = asset_loader.Load(p, [a, p]() { return LoadAsset(*a, p); });
+  }
+
+  //Blocks until loaded, returns false if it failed
+  bool Wait() const { return loaded.valid() && loaded.get(); }
+  bool IsReady() const { return loaded.valid() && loaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+  T& Get() { return asset; }
+  T* operator->() { return &asset; }
+
+private:
+  T asset;
+  std::shared_future<bool> loaded;
+};
+
+//Drop-in for sf::Sound with its own buffer, silent until the buffer has loaded
+class AsyncSound {
+public:
+  AsyncSound() : bound(false) {}
+
+  void Load(const char* path) { buffer.Load(path); }
+
+  void setVolume(float volume) { sound.setVolume(volume); }
+  void play();
+
+private:
+  AsyncAsset<sf::SoundBuffer> buffer;
+  sf::Sound sound;
+  bool bound;
+};
@@ -0,0 +1,113 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Res.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Packs asset files into the single file the game memory maps at startup.
+//Each file is stored under the path it was given, which is how Res.h names it.
+//
+//  asset_packer out.pack assets/frag.glsl assets/vert.glsl ...
+
+struct Asset {
+  std::string name;
+  std::string data;
+};
+
+static bool NameLess(const Asset& a, const Asset& b) {
+  return a.name < b.name;
+}
+
+static size_t AlignUp(size_t x) {
+  return (x + res_pack_align - 1) / res_pack_align * res_pack_align;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: asset_packer out.pack files..." << std::endl;
+    return 1;
+  }
+
+  //Read everything, the index is sorted so the game can binary search it
+  std::vector<Asset> assets(argc - 2);
+  for (int i = 2; i < argc; ++i) {
+    Asset& asset = assets[i - 2];
+    asset.name = argv[i];
+    std::replace(asset.name.begin(), asset.name.end(), '\\', '/');
+    if (asset.name.size() >= res_name_len) {
+      std::cerr << "Asset name too long: " << asset.name << std::endl;
+      return 1;
+    }
+    std::ifstream fin(argv[i], std::ios::binary);
+    if (!fin) {
+      std::cerr << "Unable to read " << argv[i] << std::endl;
+      return 1;
+    }
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    asset.data = ss.str();
+  }
+  std::sort(assets.begin(), assets.end(), NameLess);
+  for (size_t i = 1; i < assets.size(); ++i) {
+    if (assets[i].name == assets[i - 1].name) {
+      std::cerr << "Duplicate asset " << assets[i].name << std::endl;
+      return 1;
+    }
+  }
+
+  //Lay out the blobs after the index
+  ResPackHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, res_pack_magic, sizeof(res_pack_magic));
+  header.num_entries = (uint32_t)assets.size();
+  std::vector<ResPackEntry> entries(assets.size());
+  size_t offset = AlignUp(sizeof(ResPackHeader) + entries.size() * sizeof(ResPackEntry));
+  for (size_t i = 0; i < assets.size(); ++i) {
+    std::memset(&entries[i], 0, sizeof(ResPackEntry));
+    std::memcpy(entries[i].name, assets[i].name.c_str(), assets[i].name.size());
+    entries[i].offset = offset;
+    entries[i].size = assets[i].data.size();
+    offset = AlignUp(offset + assets[i].data.size());
+  }
+
+  std::ofstream fout(argv[1], std::ios::binary);
+  if (!fout) {
+    std::cerr << "Unable to write " << argv[1] << std::endl;
+    return 1;
+  }
+  fout.write((const char*)&header, sizeof(header));
+  if (!entries.empty()) {
+    fout.write((const char*)&entries[0], entries.size() * sizeof(ResPackEntry));
+  }
+  for (size_t i = 0; i < assets.size(); ++i) {
+    //Zero padding up to where the blob starts
+    const std::string padding(entries[i].offset - (size_t)fout.tellp(), '\0');
+    fout.write(padding.data(), padding.size());
+    fout.write(assets[i].data.data(), assets[i].data.size());
+  }
+  if (!fout) {
+    std::cerr << "Failed writing " << argv[1] << std::endl;
+    return 1;
+  }
+  std::cout << "Packed " << assets.size() << " assets into " << argv[1] << " (" << fout.tellp() << " bytes)" << std::endl;
+  return 0;
+}
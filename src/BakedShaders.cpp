@@ -0,0 +1,119 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "BakedShaders.h"
+#include "GL3Backend.h"
+#include <SFML/OpenGL.hpp>
+#include <cmath>
+#include <cstdio>
+
+//Always has a decimal point and exponent, so GLSL reads it as a float
+static std::string GlslFloat(double x) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.9e", x);
+  return buf;
+}
+
+static std::string GlslVec3(double x, double y, double z) {
+  return "vec3(" + GlslFloat(x) + "," + GlslFloat(y) + "," + GlslFloat(z) + ")";
+}
+
+ShaderDefines GetBakedDefines(const FractalParams& params) {
+  ShaderDefines defines;
+  defines["FRAC_SCALE"] = GlslFloat(params[0]);
+  defines["FRAC_ANG1_SIN"] = GlslFloat(std::sin((double)params[1]));
+  defines["FRAC_ANG1_COS"] = GlslFloat(std::cos((double)params[1]));
+  defines["FRAC_ANG2_SIN"] = GlslFloat(std::sin((double)params[2]));
+  defines["FRAC_ANG2_COS"] = GlslFloat(std::cos((double)params[2]));
+  defines["FRAC_SHIFT"] = GlslVec3(params[3], params[4], params[5]);
+  defines["FRAC_COL"] = GlslVec3(params[6], params[7], params[8]);
+  return defines;
+}
+
+BakedShaders::BakedShaders() : quit(false) {
+}
+
+BakedShaders::~BakedShaders() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_one();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool BakedShaders::Get(int level, int quality, const FractalParams& params, QualityShaders& out) {
+  if (level < 0 || level >= num_levels) { return false; }
+  const Level& lvl = all_levels[level];
+  if (lvl.IsAnimated()) { return false; }
+
+  const Key key(level, quality);
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<Key, State>::const_iterator state = states.find(key);
+  if (state == states.end()) {
+    //The newest request is the level on screen, so it goes first
+    states[key] = QUEUED;
+    queue.push_front(key);
+    if (!worker.joinable()) {
+      worker = std::thread(&BakedShaders::Run, this);
+    }
+    wake.notify_one();
+    return false;
+  }
+  if (state->second != READY) {
+    return false;
+  }
+
+  //Blends between levels go through parameters no shader was baked for
+  if ((params - lvl.params).cwiseAbs().maxCoeff() > baked_tolerance) {
+    return false;
+  }
+  out = shaders[key];
+  return true;
+}
+
+void BakedShaders::Run() {
+  //Shaders need an active context on this thread, SFML shares its objects
+  //with the window's context. It has to support the same GLSL version.
+  sf::ContextSettings settings;
+  if (gl3_enabled) {
+    settings.majorVersion = 3;
+    settings.minorVersion = 3;
+  }
+  sf::Context context(settings, 1, 1);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [this] { return quit || !queue.empty(); });
+    if (quit) { return; }
+    const Key key = queue.front();
+    queue.pop_front();
+    lock.unlock();
+
+    QualityShaders result;
+    const bool ok = GetQualityShaders(cache, key.second, result, GetBakedDefines(all_levels[key.first].params));
+    result.baked = true;
+
+    //Make sure the programs are complete before another context uses them
+    glFinish();
+
+    lock.lock();
+    shaders[key] = result;
+    states[key] = (ok ? READY : FAILED);
+  }
+}
@@ -0,0 +1,66 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Level.h"
+#include "Quality.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+static const float baked_tolerance = 1e-5f;  //Largest parameter difference that still counts as the level's fractal
+
+//Defines that replace the fractal uniforms with constants, including the
+//sines and cosines of the rotations
+ShaderDefines GetBakedDefines(const FractalParams& params);
+
+//Fractal shaders specialized for one level, with its parameters compiled in
+//as constants so the distance estimator loop does no trig and reads no
+//uniforms. They are compiled on a background thread while the level is
+//being shown, and the generic shaders draw everything until they are ready:
+//the intro, animated levels and the blends between levels.
+class BakedShaders {
+public:
+  BakedShaders();
+  ~BakedShaders();
+
+  //Fills out with the level's own shaders if they are compiled and params
+  //are still the level's. Otherwise queues them to compile and returns false.
+  bool Get(int level, int quality, const FractalParams& params, QualityShaders& out);
+
+protected:
+  void Run();
+
+private:
+  typedef std::pair<int, int> Key;
+  enum State {
+    QUEUED,
+    READY,
+    FAILED,
+  };
+
+  ShaderCache                 cache;  //Only used by the worker
+  std::map<Key, State>        states;
+  std::map<Key, QualityShaders> shaders;
+  std::deque<Key>             queue;
+  std::mutex                  mutex;
+  std::condition_variable     wake;
+  std::thread                 worker;
+  bool                        quit;
+};
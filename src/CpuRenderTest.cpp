@@ -0,0 +1,117 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Level.h"
+#include "CpuRenderer.h"
+#include "SceneUniforms.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Renders the start of a level with CpuRenderer and compares it with a frame that
+//frag.glsl rendered from the same uniforms. Returns non-zero if too many pixels
+//are further off than the tolerance. The reference comes from
+//
+//  MarbleMarcher --headless --path start --level 1 --frames 1 --size 160x90 --format ppm
+//
+//  cpu_render_test --reference FILE [--out FILE]
+
+static const int ref_level = 0;
+static const int ref_width = 160;
+static const int ref_height = 90;
+static const int tolerance = 8;                //Max difference of any channel, out of 255
+static const float max_outlier_ratio = 0.01f;  //Pixels allowed past it, on the edges of the fractal
+
+//Binary PPM, the same as headless --format ppm writes
+static bool LoadPPM(const std::string& fname, int& width, int& height, std::vector<unsigned char>& rgb) {
+  std::ifstream fin(fname.c_str(), std::ios::binary);
+  std::string magic;
+  int max_val = 0;
+  if (!(fin >> magic >> width >> height >> max_val) || magic != "P6" || max_val != 255 || width < 1 || height < 1) {
+    return false;
+  }
+  fin.get();
+  rgb.resize((size_t)width * height * 3);
+  fin.read((char*)rgb.data(), rgb.size());
+  return fin.good();
+}
+
+static bool SavePPM(const std::string& fname, int width, int height, const std::vector<unsigned char>& rgba) {
+  std::ofstream fout(fname.c_str(), std::ios::binary);
+  fout << "P6\n" << width << " " << height << "\n255\n";
+  for (size_t i = 0; i < (size_t)width * height; ++i) {
+    fout.write((const char*)&rgba[i*4], 3);
+  }
+  return fout.good();
+}
+
+int main(int argc, char *argv[]) {
+  std::string ref_file;
+  std::string out_file;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--reference") == 0 && i + 1 < argc) {
+      ref_file = argv[++i];
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_file = argv[++i];
+    } else {
+      ref_file.clear();
+      break;
+    }
+  }
+  if (ref_file.empty()) {
+    std::cerr << "Usage: cpu_render_test --reference FILE [--out FILE]" << std::endl;
+    return 2;
+  }
+
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> ref;
+  if (!LoadPPM(ref_file, width, height, ref) || width != ref_width || height != ref_height) {
+    std::cerr << "Failed to load a " << ref_width << "x" << ref_height << " frame from " << ref_file << std::endl;
+    return 1;
+  }
+
+  CpuRenderer renderer;
+  std::vector<unsigned char> rgba;
+  renderer.Render(SceneUniforms::LevelStart(all_levels[ref_level]), width, height, rgba);
+  if (!out_file.empty() && !SavePPM(out_file, width, height, rgba)) {
+    std::cerr << "Failed to write " << out_file << std::endl;
+  }
+
+  int max_diff = 0;
+  double sum_diff = 0.0;
+  int num_outliers = 0;
+  const int num_pixels = width * height;
+  for (int i = 0; i < num_pixels; ++i) {
+    int diff = 0;
+    for (int c = 0; c < 3; ++c) {
+      diff = std::max(diff, std::abs((int)rgba[i*4 + c] - (int)ref[i*3 + c]));
+    }
+    max_diff = std::max(max_diff, diff);
+    sum_diff += diff;
+    num_outliers += (diff > tolerance ? 1 : 0);
+  }
+
+  const bool ok = (num_outliers <= num_pixels * max_outlier_ratio);
+  std::printf("Level %d at %dx%d: mean difference %.2f, max %d, %d pixels over %d%s\n", ref_level + 1,
+              width, height, sum_diff / num_pixels, max_diff, num_outliers, tolerance, (ok ? "" : " FAILED"));
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,447 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CpuRenderer.h"
+#include "FractalBatch.h"
+#include "FractalKernel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+//Must match the defines at the top of frag.glsl. Only the code paths the shader
+//has enabled are implemented (shadows, enhanced diffuse, sun, no fog, no AA),
+//without the cone prepass or the shadow buffer, like headless GPU renders.
+static const float ao_color_delta = 0.7f;
+static const float ao_strength = 0.008f;
+static const float focal_dist = 1.73205080757f;
+static const float max_dist = 30.0f;
+static const float max_marches = 1000.0f;
+static const float min_dist = 1e-5f;
+static const float shadow_darkness = 0.7f;
+static const float shadow_max_dist = 15.0f;
+static const float shadow_secondary_marches = 48.0f;
+static const float shadow_sharpness = 10.0f;
+static const int specular_highlight = 40;
+static const float specular_mult = 0.25f;
+static const float sun_sharpness = 2.0f;
+static const float sun_size = 0.004f;
+static const float vignette_strength = 0.5f;
+static const int tile_size = 16;
+
+static Eigen::Vector3f BackgroundColor() { return Eigen::Vector3f(0.6f, 0.8f, 1.0f); }
+static Eigen::Vector3f LightColor() { return Eigen::Vector3f(1.0f, 0.95f, 0.8f); }
+static Eigen::Vector3f LightDirection() { return Eigen::Vector3f(-0.36f, 0.8f, 0.48f); }
+
+//Everything the shader reads from uniforms, for one frame
+struct Frame {
+  FractalKernel<fractal_iters> kernel;
+  FractalParams   frac_params;
+  Eigen::Matrix3f cam_rot;
+  Eigen::Vector3f cam_pos;
+  Eigen::Vector3f marble_pos;
+  float           marble_rad;
+  Eigen::Vector3f flag_pos;
+  float           flag_scale;
+  Eigen::Vector3f frac_col;
+  float           exposure;
+  int             width;
+  int             height;
+};
+
+//State of one ray in ray_march()
+struct March {
+  Eigen::Vector3f p;
+  Eigen::Vector3f ray;
+  float sharpness;
+  float max_steps;
+  float max_distance;
+  float d, s, td, min_d;
+};
+
+//One ray through scene(), and the color it returned
+struct Shade {
+  Eigen::Vector3f p;
+  Eigen::Vector3f ray;
+  float vignette;
+  Eigen::Vector3f col;
+  float col_w;
+};
+
+static Shade MakeShade(const Eigen::Vector3f& p, const Eigen::Vector3f& ray, float vignette) {
+  Shade sh;
+  sh.p = p;
+  sh.ray = ray;
+  sh.vignette = vignette;
+  sh.col.setZero();
+  sh.col_w = 0.0f;
+  return sh;
+}
+
+static float DEBox(const Eigen::Vector3f& p, const Eigen::Vector3f& s) {
+  const Eigen::Vector3f a = p.cwiseAbs() - s;
+  return std::min(std::max(std::max(a.x(), a.y()), a.z()), 0.0f) + a.cwiseMax(0.0f).norm();
+}
+
+static float DECapsule(Eigen::Vector3f p, float h, float r) {
+  p.y() -= std::min(std::max(p.y(), -h), h);
+  return p.norm() - r;
+}
+
+static float DEMarble(const Frame& f, const Eigen::Vector3f& p) {
+  return (p - f.marble_pos).norm() - f.marble_rad;
+}
+
+static float DEFlagBox(const Frame& f, const Eigen::Vector3f& p) {
+  const Eigen::Vector3f f_pos = f.flag_pos + Eigen::Vector3f(1.5f, 4.0f, 0.0f)*f.flag_scale;
+  return DEBox(p - f_pos, Eigen::Vector3f(1.5f, 0.8f, 0.08f)*f.marble_rad);
+}
+
+static float DEFlagPole(const Frame& f, const Eigen::Vector3f& p) {
+  return DECapsule(p - (f.flag_pos + Eigen::Vector3f(0.0f, f.flag_scale*2.4f, 0.0f)), f.marble_rad*2.4f, f.marble_rad*0.18f);
+}
+
+//col_scene() from the shader: fractal orbit trap color, flag colors, and w = 1 on the marble
+static void ColScene(const Frame& f, const Eigen::Vector3f& pt, Eigen::Vector3f& col, float& col_w) {
+  Eigen::Vector3f p = pt;
+  Eigen::Vector3f orbit = Eigen::Vector3f::Zero();
+  for (int i = 0; i < fractal_iters; ++i) {
+    f.kernel.Fold(p);
+    orbit = orbit.cwiseMax(p.cwiseProduct(f.frac_col));
+  }
+  col = orbit;
+  float d = f.kernel.BoxDE(p);
+  const float d1 = DEFlagBox(f, pt);
+  const float d2 = DEFlagPole(f, pt);
+  const float df = std::min(d1, d2);
+  if (df < d) {
+    col = (d1 < d2 ? Eigen::Vector3f(1.0f, 0.2f, 0.1f) : Eigen::Vector3f(0.9f, 0.9f, 0.1f));
+    d = df;
+  }
+  if (DEMarble(f, pt) < d) {
+    col.setZero();
+    col_w = 1.0f;
+  } else {
+    col_w = 0.0f;
+  }
+}
+
+//Per thread scratch space, so tiles never allocate once warmed up
+class TileTracer {
+public:
+  TileTracer(const Frame& f) : num_rays(0), num_des(0), frame(f) {}
+
+  void RenderTile(int x0, int y0, int x1, int y1, unsigned char* rgba);
+
+  size_t num_rays;
+  size_t num_des;
+
+private:
+  void SceneDE(size_t n);
+  void RayMarch(std::vector<March>& rays);
+  void ShadeScene(std::vector<Shade>& shades, float shadow_steps);
+
+  const Frame&         frame;
+  std::vector<float>   xs, ys, zs, out;
+  std::vector<size_t>  active;
+  std::vector<March>   marches;
+  std::vector<March>   shadows;
+  std::vector<size_t>  hits;
+  std::vector<Shade>   primary;
+  std::vector<Shade>   secondary;
+  std::vector<size_t>  glass;
+};
+
+//de_scene() for the first n points in xs, ys, zs
+void TileTracer::SceneDE(size_t n) {
+  FractalDEBatch(frame.frac_params, fractal_iters, xs.data(), ys.data(), zs.data(), out.data(), n);
+  for (size_t i = 0; i < n; ++i) {
+    const Eigen::Vector3f p(xs[i], ys[i], zs[i]);
+    float d = std::min(out[i], DEMarble(frame, p));
+    d = std::min(d, std::min(DEFlagBox(frame, p), DEFlagPole(frame, p)));
+    out[i] = d;
+  }
+  num_des += n;
+}
+
+//ray_march() for every ray at once, or soft_shadow() for rays with a sharpness
+//other than 1. Each round advances all unfinished rays by one step, so the
+//fractal is always evaluated for as many points as possible.
+void TileTracer::RayMarch(std::vector<March>& rays) {
+  const size_t n = rays.size();
+  num_rays += n;
+  xs.resize(std::max(xs.size(), n)); ys.resize(xs.size()); zs.resize(xs.size()); out.resize(xs.size());
+  for (size_t i = 0; i < n; ++i) {
+    xs[i] = rays[i].p.x(); ys[i] = rays[i].p.y(); zs[i] = rays[i].p.z();
+  }
+  SceneDE(n);
+
+  active.clear();
+  for (size_t i = 0; i < n; ++i) {
+    March& m = rays[i];
+    m.d = out[i];
+    if (m.d < 0.0f && m.sharpness == 1.0f) {
+      const Eigen::Vector3f v = frame.marble_pos - frame.cam_pos;
+      m.d = v.dot(v) / v.dot(m.ray) - frame.marble_rad;
+    }
+    m.s = 0.0f;
+    m.td = 0.0f;
+    m.min_d = 1.0f;
+    active.push_back(i);
+  }
+
+  while (!active.empty()) {
+    //Step every ray that isn't done yet
+    size_t num_active = 0;
+    for (size_t a = 0; a < active.size(); ++a) {
+      March& m = rays[active[a]];
+      if (!(m.s < m.max_steps)) {
+        continue;
+      } else if (m.d < min_dist) {
+        m.s += m.d / min_dist;
+        continue;
+      } else if (m.td > m.max_distance) {
+        continue;
+      }
+      m.td += m.d;
+      m.p += m.ray * m.d;
+      m.min_d = std::min(m.min_d, m.sharpness * m.d / m.td);
+      xs[num_active] = m.p.x(); ys[num_active] = m.p.y(); zs[num_active] = m.p.z();
+      active[num_active++] = active[a];
+    }
+    active.resize(num_active);
+
+    //Then get the new distances all together
+    SceneDE(num_active);
+    for (size_t a = 0; a < num_active; ++a) {
+      March& m = rays[active[a]];
+      m.d = out[a];
+      m.s += 1.0f;
+    }
+  }
+}
+
+//scene() for every ray at once, leaving the hit point in p and the normal in ray.
+//Shadow marches capped below max_marches also stop at shadow_max_dist.
+void TileTracer::ShadeScene(std::vector<Shade>& shades, float shadow_steps) {
+  const size_t n = shades.size();
+  marches.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    marches[i].p = shades[i].p;
+    marches[i].ray = shades[i].ray;
+    marches[i].sharpness = 1.0f;
+    marches[i].max_steps = max_marches;
+    marches[i].max_distance = max_dist;
+  }
+  RayMarch(marches);
+
+  //Surface normals from central differences, all six offsets of every hit at once
+  hits.clear();
+  for (size_t i = 0; i < n; ++i) {
+    if (marches[i].d < min_dist) {
+      hits.push_back(i);
+    }
+  }
+  const size_t num_hits = hits.size();
+  xs.resize(std::max(xs.size(), num_hits*6)); ys.resize(xs.size()); zs.resize(xs.size()); out.resize(xs.size());
+  for (size_t h = 0; h < num_hits; ++h) {
+    const Eigen::Vector3f& p = marches[hits[h]].p;
+    for (int k = 0; k < 6; ++k) {
+      Eigen::Vector3f q = p;
+      q[k / 2] += (k % 2 == 0 ? min_dist : -min_dist);
+      xs[h*6 + k] = q.x(); ys[h*6 + k] = q.y(); zs[h*6 + k] = q.z();
+    }
+  }
+  SceneDE(num_hits*6);
+  shadows.resize(num_hits);
+  for (size_t h = 0; h < num_hits; ++h) {
+    Eigen::Vector3f nrm(out[h*6 + 0] - out[h*6 + 1], out[h*6 + 2] - out[h*6 + 3], out[h*6 + 4] - out[h*6 + 5]);
+    nrm /= nrm.norm();
+    shades[hits[h]].ray = nrm;
+    shadows[h].p = marches[hits[h]].p + nrm * (min_dist * 100.0f);
+    shadows[h].ray = LightDirection();
+    shadows[h].sharpness = shadow_sharpness;
+    shadows[h].max_steps = shadow_steps;
+    shadows[h].max_distance = (shadow_steps < max_marches ? shadow_max_dist : max_dist);
+  }
+  RayMarch(shadows);
+
+  //Lighting, same order of operations as the shader
+  const Eigen::Vector3f light_dir = LightDirection();
+  const Eigen::Vector3f light_col = LightColor();
+  size_t h = 0;
+  for (size_t i = 0; i < n; ++i) {
+    Shade& sh = shades[i];
+    const March& m = marches[i];
+    sh.p = m.p;
+    if (h < num_hits && hits[h] == i) {
+      const Eigen::Vector3f& nrm = sh.ray;
+      const Eigen::Vector3f reflected = m.ray - 2.0f*m.ray.dot(nrm) * nrm;
+
+      Eigen::Vector3f orig_col;
+      float orig_w;
+      ColScene(frame, m.p, orig_col, orig_w);
+      orig_col = orig_col.cwiseMax(0.0f).cwiseMin(1.0f);
+      sh.col.setZero();
+      sh.col_w = orig_w;
+
+      //A shadow march that runs out of steps counts as reaching the light
+      const March& rm = shadows[h];
+      const float shadow_td = (rm.d >= min_dist ? std::max(rm.td, 1.0f) : rm.td);
+      float k = rm.min_d * std::min(shadow_td, 1.0f);
+
+      const float specular = std::pow(std::max(reflected.dot(light_dir), 0.0f), (float)specular_highlight);
+      sh.col += specular * light_col * (k * specular_mult);
+
+      k = std::min(k, shadow_darkness * 0.5f * (nrm.dot(light_dir) - 1.0f) + 1.0f);
+      k = std::max(k, 1.0f - shadow_darkness);
+      sh.col += orig_col.cwiseProduct(light_col) * k;
+
+      const float a = 1.0f / (1.0f + m.s * ao_strength);
+      sh.col += Eigen::Vector3f::Constant((1.0f - a) * ao_color_delta);
+      h += 1;
+    } else {
+      sh.col = BackgroundColor() * sh.vignette;
+      sh.col_w = 0.0f;
+      float sun_spec = m.ray.dot(light_dir) - 1.0f + sun_size;
+      sun_spec = std::min(std::exp(sun_spec * sun_sharpness / sun_size), 1.0f);
+      sh.col += light_col * sun_spec;
+    }
+  }
+}
+
+static Eigen::Vector3f Refraction(const Eigen::Vector3f& rd, const Eigen::Vector3f& n, float p) {
+  const float dot_nd = rd.dot(n);
+  return p * (rd - dot_nd * n) + std::sqrt(1.0f - (p * p) * (1.0f - dot_nd * dot_nd)) * n;
+}
+
+//main() of the shader for every pixel of the tile, y measured from the bottom like gl_FragCoord
+void TileTracer::RenderTile(int x0, int y0, int x1, int y1, unsigned char* rgba) {
+  const float w = (float)frame.width;
+  const float h = (float)frame.height;
+  primary.clear();
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      const Eigen::Vector2f screen_pos((x + 0.5f) / w, (y + 0.5f) / h);
+      Eigen::Vector2f uv = screen_pos*2.0f - Eigen::Vector2f::Ones();
+      uv.x() *= w / h;
+
+      const Eigen::Vector3f ray = frame.cam_rot * Eigen::Vector3f(uv.x(), uv.y(), -focal_dist).normalized();
+      const float vignette = 1.0f - vignette_strength * (screen_pos - Eigen::Vector2f(0.5f, 0.5f)).norm();
+      primary.push_back(MakeShade(frame.cam_pos, ray, vignette));
+    }
+  }
+  ShadeScene(primary, max_marches);
+
+  //The glass marble needs a refracted and a reflected ray. The primary
+  //rays are still in marches until the secondary ones get traced.
+  glass.clear();
+  secondary.clear();
+  for (size_t i = 0; i < primary.size(); ++i) {
+    if (primary[i].col_w <= 0.5f) {
+      continue;
+    }
+    const Eigen::Vector3f& r = marches[i].ray;
+    const Eigen::Vector3f& p = primary[i].p;
+    Eigen::Vector3f n = (frame.marble_pos - p).normalized();
+    Eigen::Vector3f q = Refraction(r, n, 1.0f / 1.5f);
+    const Eigen::Vector3f p2 = p + (q.dot(n) * 2.0f * frame.marble_rad) * q;
+    n = (p2 - frame.marble_pos).normalized();
+    q = (q.dot(r) * 2.0f) * q - r;
+    secondary.push_back(MakeShade(p2 + n * (min_dist * 10.0f), q, 0.8f));
+
+    n = (p - frame.marble_pos).normalized();
+    q = r - n*(2.0f*r.dot(n));
+    secondary.push_back(MakeShade(p + n * (min_dist * 10.0f), q, 0.8f));
+    glass.push_back(i);
+  }
+  ShadeScene(secondary, shadow_secondary_marches);
+  for (size_t g = 0; g < glass.size(); ++g) {
+    Shade& sh = primary[glass[g]];
+    sh.col = secondary[g*2].col * 0.6f + secondary[g*2 + 1].col * 0.4f + sh.col;
+  }
+
+  //Exposure and 8-bit output, flipped so the top row comes first
+  size_t i = 0;
+  for (int y = y0; y < y1; ++y) {
+    unsigned char* row = rgba + (size_t)(frame.height - 1 - y) * frame.width * 4;
+    for (int x = x0; x < x1; ++x, ++i) {
+      const Eigen::Vector3f col = (primary[i].col * frame.exposure).cwiseMax(0.0f).cwiseMin(1.0f);
+      row[x*4 + 0] = (unsigned char)(col.x() * 255.0f + 0.5f);
+      row[x*4 + 1] = (unsigned char)(col.y() * 255.0f + 0.5f);
+      row[x*4 + 2] = (unsigned char)(col.z() * 255.0f + 0.5f);
+      row[x*4 + 3] = 255;
+    }
+  }
+}
+
+CpuRenderer::CpuRenderer() :
+  num_threads(0),
+  num_rays(0),
+  num_des(0),
+  seconds(0.0) {
+}
+
+void CpuRenderer::Render(const SceneUniforms& u, int width, int height, std::vector<unsigned char>& rgba) {
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Frame frame;
+  frame.kernel.Build(u.frac_params);
+  frame.frac_params = u.frac_params;
+  frame.cam_rot = u.cam_mat.block<3, 3>(0, 0);
+  frame.cam_pos = u.cam_mat.block<3, 1>(0, 3);
+  frame.marble_pos = u.marble_pos;
+  frame.marble_rad = u.marble_rad;
+  frame.flag_pos = u.flag_pos;
+  frame.flag_scale = u.flag_scale;
+  frame.frac_col = u.frac_params.segment<3>(6);
+  frame.exposure = u.exposure;
+  frame.width = width;
+  frame.height = height;
+  rgba.resize((size_t)width * height * 4);
+
+  //Threads take the next tile until none are left
+  const int tiles_x = (width + tile_size - 1) / tile_size;
+  const int tiles_y = (height + tile_size - 1) / tile_size;
+  const int num_tiles = tiles_x * tiles_y;
+  int threads = (num_threads > 0 ? num_threads : (int)std::thread::hardware_concurrency());
+  threads = std::max(1, std::min(threads, num_tiles));
+  std::atomic<int> next_tile(0);
+  std::vector<TileTracer> tracers(threads, TileTracer(frame));
+  auto work = [&](int t) {
+    for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+      const int x0 = (tile % tiles_x) * tile_size;
+      const int y0 = (tile / tiles_x) * tile_size;
+      tracers[t].RenderTile(x0, y0, std::min(x0 + tile_size, width), std::min(y0 + tile_size, height), rgba.data());
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t) {
+    workers.emplace_back(work, t);
+  }
+  work(0);
+  for (size_t t = 0; t < workers.size(); ++t) {
+    workers[t].join();
+  }
+
+  num_rays = 0;
+  num_des = 0;
+  for (int t = 0; t < threads; ++t) {
+    num_rays += tracers[t].num_rays;
+    num_des += tracers[t].num_des;
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,46 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "SceneUniforms.h"
+#include <cstddef>
+#include <vector>
+
+//Software version of frag.glsl for machines without a GPU. Renders the same
+//image from the uniforms Scene::Write would send, split into tiles across all
+//cores, with the fractal distance estimates of each tile evaluated with SIMD.
+class CpuRenderer {
+public:
+  CpuRenderer();
+
+  //Number of threads to render with, 0 uses one per core
+  void SetThreads(int n) { num_threads = n; }
+
+  //Render a frame into 8-bit RGBA pixels, top row first like sf::Image
+  void Render(const SceneUniforms& u, int width, int height, std::vector<unsigned char>& rgba);
+
+  //Statistics of the last frame. Rays include shadow and marble reflection rays.
+  size_t GetNumRays() const { return num_rays; }
+  size_t GetNumDEs() const { return num_des; }
+  double GetSeconds() const { return seconds; }
+  double GetRaysPerSecond() const { return seconds > 0.0 ? num_rays / seconds : 0.0; }
+
+private:
+  int    num_threads;
+  size_t num_rays;
+  size_t num_des;
+  double seconds;
+};
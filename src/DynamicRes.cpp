@@ -0,0 +1,246 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "DynamicRes.h"
+#include "GL3Backend.h"
+#include "Res.h"
+#include "Scene.h"
+#include "ShaderVariant.h"
+#include <algorithm>
+#include <cmath>
+
+//Maps a width x height view onto the bottom left corner of a target, where
+//gl_FragCoord starts at zero, so a shader only needs to know its resolution
+static sf::View CornerView(float width, float height, unsigned int max_width, unsigned int max_height) {
+  sf::View view(sf::FloatRect(0.0f, 0.0f, width, height));
+  view.setViewport(sf::FloatRect(0.0f, 1.0f - height / float(max_height),
+                                 width / float(max_width), height / float(max_height)));
+  return view;
+}
+
+DynamicRes::DynamicRes() :
+  cone_shader(nullptr),
+  shadow_shader(nullptr),
+  baked(false),
+  gl3(nullptr),
+  max_width(1),
+  max_height(1),
+  width(1),
+  height(1),
+  scale(1.0f),
+  budget(dyn_res_share / 60.0f),
+  smooth_time(budget * dyn_res_up),
+  settle(0),
+  enabled(true) {
+}
+
+bool DynamicRes::Create(unsigned int _max_width, unsigned int _max_height, const sf::ContextSettings& settings) {
+  if (!LoadShaderRes(upscale, upscale_glsl, sf::Shader::Fragment)) {
+    return false;
+  }
+  if (!texture.create(_max_width, _max_height, settings)) {
+    return false;
+  }
+  if (!taa.Create(_max_width, _max_height, settings)) {
+    return false;
+  }
+  if (!cone.create((_max_width + cone_tile - 1) / cone_tile, (_max_height + cone_tile - 1) / cone_tile, settings)) {
+    return false;
+  }
+  if (!shadow.create((_max_width + shadow_tile - 1) / shadow_tile, (_max_height + shadow_tile - 1) / shadow_tile, settings)) {
+    return false;
+  }
+  texture.setSmooth(true);
+  max_width = _max_width;
+  max_height = _max_height;
+  Resize();
+  return true;
+}
+
+void DynamicRes::SetPasses(sf::Shader* cone, sf::Shader* shadow, bool _baked) {
+  cone_shader = cone;
+  shadow_shader = shadow;
+  baked = _baked;
+}
+
+void DynamicRes::SetBackend(GL3Backend* backend) {
+  gl3 = backend;
+}
+
+void DynamicRes::SetEnabled(bool enable) {
+  enabled = enable;
+  scale = 1.0f;
+  smooth_time = budget * dyn_res_up;
+  settle = dyn_res_settle;
+  Resize();
+}
+
+void DynamicRes::Draw(sf::Shader& shader, sf::RenderTarget& target, const SceneUniforms& frame) {
+  const sf::Vector2f size((float)width, (float)height);
+  sf::RenderStates states;
+  states.blendMode = sf::BlendNone;
+
+  //The passes are timed and drawn in the window's context. The backend keeps
+  //the scene values there in one buffer every pass reads.
+  if (enabled || gl3) {
+    target.setActive(true);
+  }
+  if (enabled) {
+    timer.Begin();
+  }
+  //Only the main pass shades, the prepasses just march
+  const int fractal = (baked ? 0 : Scene::UNIFORMS_FRACTAL);
+  if (gl3) {
+    gl3->SetScene(frame);
+  } else {
+    Scene::Write(shader, frame, fractal | Scene::UNIFORMS_SHADING);
+  }
+
+  //Find how far each tile is from the fractal. The cone shader still works in
+  //full resolution pixels, only the viewport is smaller.
+  if (cone_shader) {
+    const unsigned int cone_width = (width + cone_tile - 1) / cone_tile;
+    const unsigned int cone_height = (height + cone_tile - 1) / cone_tile;
+    const sf::Vector2u cone_max = cone.getSize();
+    cone_shader->setUniform("iResolution", size);
+    cone_shader->setUniform("iConeTile", (float)cone_tile);
+    if (gl3) {
+      gl3->Draw(*cone_shader, cone, cone_width, cone_height);
+    } else {
+      Scene::Write(*cone_shader, frame, fractal);
+      cone.setView(CornerView(float(cone_width), float(cone_height), cone_max.x, cone_max.y));
+      states.shader = cone_shader;
+      cone.draw(quad, states);
+      cone.display();
+    }
+    shader.setUniform("iConeDepth", cone.getTexture());
+    shader.setUniform("iConeSize", sf::Glsl::Vec2((float)cone_max.x, (float)cone_max.y));
+  }
+  shader.setUniform("iConeTile", cone_shader ? (float)cone_tile : 0.0f);
+
+  //Shadows at lower resolution, the main pass upsamples them
+  if (shadow_shader) {
+    const unsigned int shadow_width = (width + shadow_tile - 1) / shadow_tile;
+    const unsigned int shadow_height = (height + shadow_tile - 1) / shadow_tile;
+    const sf::Vector2u shadow_max = shadow.getSize();
+    shadow_shader->setUniform("iResolution", size);
+    shadow_shader->setUniform("iShadowTile", (float)shadow_tile);
+    shadow_shader->setUniform("iConeTile", cone_shader ? (float)cone_tile : 0.0f);
+    if (cone_shader) {
+      shadow_shader->setUniform("iConeDepth", cone.getTexture());
+      shadow_shader->setUniform("iConeSize", sf::Glsl::Vec2(cone.getSize()));
+    }
+    if (gl3) {
+      gl3->Draw(*shadow_shader, shadow, shadow_width, shadow_height);
+    } else {
+      Scene::Write(*shadow_shader, frame, fractal);
+      shadow.setView(CornerView(float(shadow_width), float(shadow_height), shadow_max.x, shadow_max.y));
+      states.shader = shadow_shader;
+      shadow.draw(quad, states);
+      shadow.display();
+    }
+    shader.setUniform("iShadowBuf", shadow.getTexture());
+    shader.setUniform("iShadowSize", sf::Glsl::Vec2(shadow_max));
+    shader.setUniform("iShadowRes", sf::Glsl::Vec2((float)shadow_width, (float)shadow_height));
+  }
+  shader.setUniform("iShadowTile", shadow_shader ? (float)shadow_tile : 0.0f);
+
+  //Render into the bottom left corner of the texture
+  shader.setUniform("iResolution", size);
+  shader.setUniform("iJitter", taa.IsEnabled() ? taa.GetJitter() : sf::Vector2f(0.0f, 0.0f));
+  shader.setUniform("iTemporal", taa.IsEnabled() ? 1.0f : 0.0f);
+  if (gl3) {
+    gl3->Draw(shader, texture, width, height);
+  } else {
+    texture.setView(CornerView(size.x, size.y, max_width, max_height));
+    states.shader = &shader;
+    texture.draw(quad, states);
+    texture.display();
+  }
+
+  //Antialias against the previous frames
+  const sf::Texture* result = &texture.getTexture();
+  if (taa.IsEnabled()) {
+    result = &taa.Resolve(texture.getTexture(), width, height, frame);
+  }
+
+  //Use whatever earlier frames the GPU has finished timing by now
+  if (enabled) {
+    timer.End();
+    float seconds;
+    while (timer.Poll(seconds)) {
+      Update(seconds);
+    }
+  }
+
+  //Stretch the rendered corner over the target, the rest of the texture may
+  //still hold older frames at a larger size. The backend's blit is a plain
+  //bilinear stretch without the sharpening.
+  if (gl3) {
+    gl3->Blit(*result, width, height, target);
+    return;
+  }
+  const sf::Vector2u target_size = target.getSize();
+  sf::Sprite sprite(*result, sf::IntRect(0, max_height - height, width, height));
+  sprite.setScale(float(target_size.x) / size.x, float(target_size.y) / size.y);
+  const float stretch = float(target_size.x) / size.x;
+  upscale.setUniform("iSource", sf::Shader::CurrentTexture);
+  upscale.setUniform("iSourceSize", size);
+  upscale.setUniform("iTextureSize", sf::Glsl::Vec2((float)max_width, (float)max_height));
+  upscale.setUniform("iSharpness", dyn_res_sharpness * std::min(std::max(stretch - 1.0f, 0.0f), 1.0f));
+  target.draw(sprite, &upscale);
+}
+
+bool DynamicRes::Update(float seconds) {
+  if (!enabled) {
+    return false;
+  }
+
+  //Hitches like level loads say nothing about the cost of the scene
+  seconds = std::min(seconds, budget * 4.0f);
+  smooth_time = smooth_time*(1.0f - dyn_res_smooth) + seconds*dyn_res_smooth;
+  if (settle > 0) {
+    settle -= 1;
+    return false;
+  }
+  if (smooth_time <= budget && smooth_time >= budget * dyn_res_up) {
+    return false;
+  }
+
+  //Render time follows the pixel count, so aim for the middle of the band
+  const float goal = budget * (1.0f + dyn_res_up) * 0.5f;
+  float new_scale = scale * std::sqrt(goal / smooth_time);
+  new_scale = std::min(std::max(new_scale, scale * (1.0f - dyn_res_max_step)), scale * (1.0f + dyn_res_max_step));
+  new_scale = std::min(std::max(new_scale, dyn_res_min_scale), 1.0f);
+  if (new_scale == scale) {
+    return false;
+  }
+
+  //Predict the new cost until it has been measured
+  smooth_time *= (new_scale * new_scale) / (scale * scale);
+  scale = new_scale;
+  settle = dyn_res_settle;
+  const unsigned int old_width = width;
+  const unsigned int old_height = height;
+  Resize();
+  return width != old_width || height != old_height;
+}
+
+void DynamicRes::Resize() {
+  width = std::max(1u, (unsigned int)(float(max_width) * scale + 0.5f));
+  height = std::max(1u, (unsigned int)(float(max_height) * scale + 0.5f));
+  quad.setSize(sf::Vector2f((float)width, (float)height));
+}
@@ -0,0 +1,104 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "GpuTimer.h"
+#include "SceneUniforms.h"
+#include "TemporalAA.h"
+#include <SFML/Graphics.hpp>
+
+class GL3Backend;
+
+static const float dyn_res_min_scale = 0.5f;       //Smallest fraction of the selected resolution
+static const float dyn_res_share = 0.8f;           //Share of the frame time the fractal may take, leaves room for overlays
+static const float dyn_res_smooth = 0.1f;          //Weight of each new frame time sample
+static const float dyn_res_up = 0.8f;              //Scale up once the smooth time is below this much of the budget
+static const float dyn_res_max_step = 0.1f;        //Largest relative change of the scale at once
+static const int dyn_res_settle = 8;               //Frames to wait after a change before measuring again
+static const float dyn_res_sharpness = 0.6f;       //Strength of the sharpening when upscaling
+static const int cone_tile = 4;                    //Pixels per side covered by one prepass cone
+static const int shadow_tile = 2;                  //Pixels per side sharing one shadow buffer texel
+
+//Renders the fractal into a texture of the selected resolution, but only uses
+//as much of it as the frame time allows. The GPU time of every frame is
+//measured with timer queries and the scale is adjusted to stay within the
+//budget. Without timer queries it stays at full size. A low resolution
+//cone prepass finds where each tile's rays can start marching and a half
+//resolution pass computes shadows. The frame goes through temporal
+//antialiasing, then is stretched to the window with a sharpening filter.
+class DynamicRes {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  DynamicRes();
+
+  //Allocates the texture at the largest size that will ever be rendered
+  bool Create(unsigned int max_width, unsigned int max_height, const sf::ContextSettings& settings);
+
+  //A disabled controller always renders at full size
+  void SetEnabled(bool enable);
+  bool IsEnabled() const { return enabled; }
+
+  //Draws the fractal shader at the current size and upscales it into target,
+  //writing the frame's uniforms to every pass
+  void Draw(sf::Shader& shader, sf::RenderTarget& target, const SceneUniforms& frame);
+
+  //Draws the passes with the GL 3.3 backend, nullptr goes through SFML
+  void SetBackend(GL3Backend* backend);
+
+  TemporalAA& GetTemporalAA() { return taa; }
+
+  //Variants of the fractal shader for the cone prepass and the shadow buffer.
+  //Without the prepass every ray marches from the camera, and without the
+  //buffer every pixel marches its own shadow ray. Either can be nullptr.
+  //Baked passes and main shaders don't get the fractal parameter uniforms.
+  void SetPasses(sf::Shader* cone, sf::Shader* shadow, bool baked);
+
+  //Feed the GPU time of a frame, returns true if the size changed
+  bool Update(float seconds);
+
+  //Time between presented frames, the render budget is a share of it
+  void SetFrameTime(float seconds) { budget = dyn_res_share * seconds; }
+
+  float GetScale() const { return scale; }
+  unsigned int GetWidth() const { return width; }
+  unsigned int GetHeight() const { return height; }
+
+protected:
+  void Resize();
+
+private:
+  sf::RenderTexture  texture;
+  sf::RectangleShape quad;
+  sf::Shader         upscale;
+  sf::RenderTexture  cone;
+  sf::Shader*        cone_shader;
+  sf::RenderTexture  shadow;
+  sf::Shader*        shadow_shader;
+  bool               baked;
+  GL3Backend*        gl3;
+  TemporalAA         taa;
+  GpuTimer           timer;
+  unsigned int       max_width;
+  unsigned int       max_height;
+  unsigned int       width;
+  unsigned int       height;
+  float              scale;
+  float              budget;
+  float              smooth_time;
+  int                settle;
+  bool               enabled;
+};
@@ -0,0 +1,277 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "FractalBatch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRACTAL_BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+#else
+#define FRACTAL_BATCH_X86 0
+#endif
+
+//Everything that stays constant across a batch
+struct BatchConsts {
+  int iters;
+  float rotz_c, rotz_s;
+  float rotx_c, rotx_s;
+  float scale;
+  float shift_x, shift_y, shift_z;
+  float w;
+};
+
+typedef void (*BatchFunc)(const BatchConsts& c, const float* xs, const float* ys, const float* zs, float* out, size_t n);
+
+static void DEBatchScalar(const BatchConsts& c, const float* xs, const float* ys, const float* zs, float* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    float x = xs[i];
+    float y = ys[i];
+    float z = zs[i];
+    for (int k = 0; k < c.iters; ++k) {
+      //absFold
+      x = std::abs(x); y = std::abs(y); z = std::abs(z);
+      //rotZ
+      const float rotz_x = c.rotz_c*x + c.rotz_s*y;
+      const float rotz_y = c.rotz_c*y - c.rotz_s*x;
+      x = rotz_x; y = rotz_y;
+      //mengerFold
+      float a = std::min(x - y, 0.0f);
+      x -= a; y += a;
+      a = std::min(x - z, 0.0f);
+      x -= a; z += a;
+      a = std::min(y - z, 0.0f);
+      y -= a; z += a;
+      //rotX
+      const float rotx_y = c.rotx_c*y + c.rotx_s*z;
+      const float rotx_z = c.rotx_c*z - c.rotx_s*y;
+      y = rotx_y; z = rotx_z;
+      //scaleTrans
+      x = x*c.scale + c.shift_x;
+      y = y*c.scale + c.shift_y;
+      z = z*c.scale + c.shift_z;
+    }
+    const float ax = std::abs(x) - 6.0f;
+    const float ay = std::abs(y) - 6.0f;
+    const float az = std::abs(z) - 6.0f;
+    const float mx = std::max(ax, 0.0f);
+    const float my = std::max(ay, 0.0f);
+    const float mz = std::max(az, 0.0f);
+    out[i] = (std::min(std::max(std::max(ax, ay), az), 0.0f) + std::sqrt(mx*mx + my*my + mz*mz)) / c.w;
+  }
+}
+
+#if FRACTAL_BATCH_X86
+static void DEBatchSSE2(const BatchConsts& c, const float* xs, const float* ys, const float* zs, float* out, size_t n) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 rotz_c = _mm_set1_ps(c.rotz_c);
+  const __m128 rotz_s = _mm_set1_ps(c.rotz_s);
+  const __m128 rotx_c = _mm_set1_ps(c.rotx_c);
+  const __m128 rotx_s = _mm_set1_ps(c.rotx_s);
+  const __m128 scale = _mm_set1_ps(c.scale);
+  const __m128 shift_x = _mm_set1_ps(c.shift_x);
+  const __m128 shift_y = _mm_set1_ps(c.shift_y);
+  const __m128 shift_z = _mm_set1_ps(c.shift_z);
+  const __m128 box = _mm_set1_ps(6.0f);
+  const __m128 w = _mm_set1_ps(c.w);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(xs + i);
+    __m128 y = _mm_loadu_ps(ys + i);
+    __m128 z = _mm_loadu_ps(zs + i);
+    for (int k = 0; k < c.iters; ++k) {
+      //absFold
+      x = _mm_andnot_ps(sign, x);
+      y = _mm_andnot_ps(sign, y);
+      z = _mm_andnot_ps(sign, z);
+      //rotZ
+      const __m128 rotz_x = _mm_add_ps(_mm_mul_ps(rotz_c, x), _mm_mul_ps(rotz_s, y));
+      const __m128 rotz_y = _mm_sub_ps(_mm_mul_ps(rotz_c, y), _mm_mul_ps(rotz_s, x));
+      x = rotz_x; y = rotz_y;
+      //mengerFold
+      __m128 a = _mm_min_ps(_mm_sub_ps(x, y), zero);
+      x = _mm_sub_ps(x, a); y = _mm_add_ps(y, a);
+      a = _mm_min_ps(_mm_sub_ps(x, z), zero);
+      x = _mm_sub_ps(x, a); z = _mm_add_ps(z, a);
+      a = _mm_min_ps(_mm_sub_ps(y, z), zero);
+      y = _mm_sub_ps(y, a); z = _mm_add_ps(z, a);
+      //rotX
+      const __m128 rotx_y = _mm_add_ps(_mm_mul_ps(rotx_c, y), _mm_mul_ps(rotx_s, z));
+      const __m128 rotx_z = _mm_sub_ps(_mm_mul_ps(rotx_c, z), _mm_mul_ps(rotx_s, y));
+      y = rotx_y; z = rotx_z;
+      //scaleTrans
+      x = _mm_add_ps(_mm_mul_ps(x, scale), shift_x);
+      y = _mm_add_ps(_mm_mul_ps(y, scale), shift_y);
+      z = _mm_add_ps(_mm_mul_ps(z, scale), shift_z);
+    }
+    const __m128 ax = _mm_sub_ps(_mm_andnot_ps(sign, x), box);
+    const __m128 ay = _mm_sub_ps(_mm_andnot_ps(sign, y), box);
+    const __m128 az = _mm_sub_ps(_mm_andnot_ps(sign, z), box);
+    const __m128 mx = _mm_max_ps(ax, zero);
+    const __m128 my = _mm_max_ps(ay, zero);
+    const __m128 mz = _mm_max_ps(az, zero);
+    const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mx, mx), _mm_mul_ps(my, my)), _mm_mul_ps(mz, mz));
+    const __m128 inner = _mm_min_ps(_mm_max_ps(_mm_max_ps(ax, ay), az), zero);
+    _mm_storeu_ps(out + i, _mm_div_ps(_mm_add_ps(inner, _mm_sqrt_ps(len2)), w));
+  }
+  DEBatchScalar(c, xs + i, ys + i, zs + i, out + i, n - i);
+}
+
+TARGET_AVX
+static void DEBatchAVX(const BatchConsts& c, const float* xs, const float* ys, const float* zs, float* out, size_t n) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 rotz_c = _mm256_set1_ps(c.rotz_c);
+  const __m256 rotz_s = _mm256_set1_ps(c.rotz_s);
+  const __m256 rotx_c = _mm256_set1_ps(c.rotx_c);
+  const __m256 rotx_s = _mm256_set1_ps(c.rotx_s);
+  const __m256 scale = _mm256_set1_ps(c.scale);
+  const __m256 shift_x = _mm256_set1_ps(c.shift_x);
+  const __m256 shift_y = _mm256_set1_ps(c.shift_y);
+  const __m256 shift_z = _mm256_set1_ps(c.shift_z);
+  const __m256 box = _mm256_set1_ps(6.0f);
+  const __m256 w = _mm256_set1_ps(c.w);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_loadu_ps(xs + i);
+    __m256 y = _mm256_loadu_ps(ys + i);
+    __m256 z = _mm256_loadu_ps(zs + i);
+    for (int k = 0; k < c.iters; ++k) {
+      //absFold
+      x = _mm256_andnot_ps(sign, x);
+      y = _mm256_andnot_ps(sign, y);
+      z = _mm256_andnot_ps(sign, z);
+      //rotZ
+      const __m256 rotz_x = _mm256_add_ps(_mm256_mul_ps(rotz_c, x), _mm256_mul_ps(rotz_s, y));
+      const __m256 rotz_y = _mm256_sub_ps(_mm256_mul_ps(rotz_c, y), _mm256_mul_ps(rotz_s, x));
+      x = rotz_x; y = rotz_y;
+      //mengerFold
+      __m256 a = _mm256_min_ps(_mm256_sub_ps(x, y), zero);
+      x = _mm256_sub_ps(x, a); y = _mm256_add_ps(y, a);
+      a = _mm256_min_ps(_mm256_sub_ps(x, z), zero);
+      x = _mm256_sub_ps(x, a); z = _mm256_add_ps(z, a);
+      a = _mm256_min_ps(_mm256_sub_ps(y, z), zero);
+      y = _mm256_sub_ps(y, a); z = _mm256_add_ps(z, a);
+      //rotX
+      const __m256 rotx_y = _mm256_add_ps(_mm256_mul_ps(rotx_c, y), _mm256_mul_ps(rotx_s, z));
+      const __m256 rotx_z = _mm256_sub_ps(_mm256_mul_ps(rotx_c, z), _mm256_mul_ps(rotx_s, y));
+      y = rotx_y; z = rotx_z;
+      //scaleTrans
+      x = _mm256_add_ps(_mm256_mul_ps(x, scale), shift_x);
+      y = _mm256_add_ps(_mm256_mul_ps(y, scale), shift_y);
+      z = _mm256_add_ps(_mm256_mul_ps(z, scale), shift_z);
+    }
+    const __m256 ax = _mm256_sub_ps(_mm256_andnot_ps(sign, x), box);
+    const __m256 ay = _mm256_sub_ps(_mm256_andnot_ps(sign, y), box);
+    const __m256 az = _mm256_sub_ps(_mm256_andnot_ps(sign, z), box);
+    const __m256 mx = _mm256_max_ps(ax, zero);
+    const __m256 my = _mm256_max_ps(ay, zero);
+    const __m256 mz = _mm256_max_ps(az, zero);
+    const __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mx, mx), _mm256_mul_ps(my, my)), _mm256_mul_ps(mz, mz));
+    const __m256 inner = _mm256_min_ps(_mm256_max_ps(_mm256_max_ps(ax, ay), az), zero);
+    _mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_add_ps(inner, _mm256_sqrt_ps(len2)), w));
+  }
+  DEBatchSSE2(c, xs + i, ys + i, zs + i, out + i, n - i);
+}
+
+static bool HasAVX() {
+#ifdef _MSC_VER
+  //Need both the CPU feature and the OS saving the YMM registers
+  int info[4];
+  __cpuid(info, 1);
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+#endif
+
+struct BatchPath {
+  BatchFunc func;
+  const char* name;
+};
+
+static BatchPath PickPath() {
+#if FRACTAL_BATCH_X86
+  if (HasAVX()) {
+    return BatchPath{ DEBatchAVX, "avx" };
+  }
+  return BatchPath{ DEBatchSSE2, "sse2" };
+#else
+  return BatchPath{ DEBatchScalar, "scalar" };
+#endif
+}
+
+static BatchPath& GetPath() {
+  static BatchPath path = PickPath();
+  return path;
+}
+
+void FractalDEBatch(const FractalParams& params, int iters,
+                    const float* xs, const float* ys, const float* zs,
+                    float* out, size_t n) {
+  //Trig and the final scale are the same for every point in the batch
+  BatchConsts c;
+  c.iters = iters;
+  c.rotz_c = std::cos(params[1]);
+  c.rotz_s = std::sin(params[1]);
+  c.rotx_c = std::cos(params[2]);
+  c.rotx_s = std::sin(params[2]);
+  c.scale = params[0];
+  c.shift_x = params[3];
+  c.shift_y = params[4];
+  c.shift_z = params[5];
+  c.w = 1.0f;
+  for (int k = 0; k < iters; ++k) {
+    c.w *= c.scale;
+  }
+  GetPath().func(c, xs, ys, zs, out, n);
+}
+
+const char* FractalBatchPath() {
+  return GetPath().name;
+}
+
+bool SetFractalBatchPath(const char* name) {
+  BatchPath& path = GetPath();
+  if (std::strcmp(name, "scalar") == 0) {
+    path = BatchPath{ DEBatchScalar, "scalar" };
+    return true;
+  }
+#if FRACTAL_BATCH_X86
+  if (std::strcmp(name, "sse2") == 0) {
+    path = BatchPath{ DEBatchSSE2, "sse2" };
+    return true;
+  } else if (std::strcmp(name, "avx") == 0 && HasAVX()) {
+    path = BatchPath{ DEBatchAVX, "avx" };
+    return true;
+  }
+#endif
+  return false;
+}
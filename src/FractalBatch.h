@@ -0,0 +1,33 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Level.h"
+#include <cstddef>
+
+//Evaluate the fractal distance estimator for n points stored as separate
+//x, y and z arrays. The widest SIMD path the CPU supports is picked once at
+//runtime (AVX, then SSE2, then scalar) and matches Scene::DE within rounding.
+void FractalDEBatch(const FractalParams& params, int iters,
+                    const float* xs, const float* ys, const float* zs,
+                    float* out, size_t n);
+
+//Name of the SIMD path FractalDEBatch dispatches to ("avx", "sse2" or "scalar")
+const char* FractalBatchPath();
+
+//Makes FractalDEBatch use the named path instead, for tests. Returns false if
+//this CPU or build doesn't have it. Not safe while other threads run batches.
+bool SetFractalBatchPath(const char* name);
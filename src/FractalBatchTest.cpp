@@ -0,0 +1,99 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Level.h"
+#include "FractalBatch.h"
+#include "FractalKernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//Checks every SIMD path of FractalDEBatch that this CPU supports against the scalar
+//FractalKernel::DE on every level. Returns non-zero if any estimate is further off
+//than the tolerance, or if the CPU's default path can't be forced.
+//
+//  fractal_batch_test
+
+static const int num_points = 4099;       //Odd, so every path also runs its scalar tail
+static const float max_rel_error = 1e-5f; //Relative to the estimate, or to min_error_scale near zero
+static const float min_error_scale = 1e-3f;
+static const char* const all_paths[] = { "avx", "sse2", "scalar" };
+
+//Fixed, seeded points spread from the marble's start out past the fractal's bounds
+static void SamplePoints(const Level& level, int seed, std::vector<float>& xs, std::vector<float>& ys, std::vector<float>& zs) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+  for (int i = 0; i < num_points; ++i) {
+    const float range = (i % 2 == 0 ? 60.0f * level.marble_rad : 8.0f);
+    xs[i] = level.start_pos.x() + u(rng) * range;
+    ys[i] = level.start_pos.y() + u(rng) * range;
+    zs[i] = level.start_pos.z() + u(rng) * range;
+  }
+}
+
+//Worst error of the current path over every level, also run from an unaligned start
+static float WorstError() {
+  std::vector<float> xs(num_points), ys(num_points), zs(num_points), out(num_points);
+  float worst = 0.0f;
+  for (int lv = 0; lv < num_levels; ++lv) {
+    const Level& level = all_levels[lv];
+    FractalKernel<fractal_iters> kernel;
+    kernel.Build(level.params);
+    SamplePoints(level, 3000 + lv, xs, ys, zs);
+    for (int start = 0; start < 2; ++start) {
+      const size_t n = num_points - start;
+      FractalDEBatch(level.params, fractal_iters, &xs[start], &ys[start], &zs[start], &out[start], n);
+      for (int i = start; i < num_points; ++i) {
+        const float expected = kernel.DE(Eigen::Vector3f(xs[i], ys[i], zs[i]));
+        const float err = std::abs(out[i] - expected) / std::max(std::abs(expected), min_error_scale);
+        worst = std::max(worst, (err == err ? err : INFINITY));
+      }
+    }
+  }
+  return worst;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    std::cerr << "Usage: fractal_batch_test" << std::endl;
+    return 2;
+  }
+
+  const std::string default_path = FractalBatchPath();
+  bool failed = false;
+  bool ran_default = false;
+  for (size_t p = 0; p < sizeof(all_paths) / sizeof(all_paths[0]); ++p) {
+    if (!SetFractalBatchPath(all_paths[p])) {
+      std::cout << all_paths[p] << ": not supported" << std::endl;
+      continue;
+    }
+    ran_default |= (default_path == all_paths[p]);
+    const float worst = WorstError();
+    const bool ok = (worst <= max_rel_error);
+    std::printf("%s: max relative error %.3g%s\n", all_paths[p], worst, (ok ? "" : " FAILED"));
+    failed |= !ok;
+  }
+  if (!ran_default) {
+    std::cerr << "Could not force the default path " << default_path << std::endl;
+    failed = true;
+  }
+  return (failed ? 1 : 0);
+}
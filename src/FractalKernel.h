@@ -0,0 +1,221 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Level.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+static const int fractal_iters = 16;
+
+//Calls f(i) for i = 0..N-1, unrolled at compile time
+template<int N>
+struct FractalUnroll {
+  template<typename F>
+  static void Run(F& f) {
+    FractalUnroll<N - 1>::Run(f);
+    f(N - 1);
+  }
+};
+template<>
+struct FractalUnroll<0> {
+  template<typename F>
+  static void Run(F&) {}
+};
+
+//The fractal fold with everything that only depends on the parameters
+//(rotation sin/cos, scale and shift) computed once in Build().
+template<int Iters>
+class FractalKernel {
+public:
+  //Which way each fold went, one byte per iteration
+  enum FoldBits {
+    NEG_X   = 1 << 0,
+    NEG_Y   = 1 << 1,
+    NEG_Z   = 1 << 2,
+    SWAP_YZ = 1 << 3,
+    SWAP_XZ = 1 << 4,
+    SWAP_XY = 1 << 5,
+  };
+
+  //A fully folded point and the decisions needed to unfold it again
+  struct Folded {
+    Eigen::Vector3f p;
+    float reach; //Sum of |p| / scale^k going into each fold k, see ShiftReach()
+    unsigned char bits[Iters];
+  };
+
+  FractalKernel() { Rebuild(FractalParams::Ones()); }
+
+  //Only rebuilds if the parameters changed, returns true if it did
+  bool Build(const FractalParams& p) {
+    if (p == params) {
+      return false;
+    }
+    Rebuild(p);
+    return true;
+  }
+
+  const FractalParams& GetParams() const { return params; }
+
+  //Each fold is scale-Lipschitz. Turning one of its rotations by da moves the point
+  //it outputs by at most scale*da*|p|, and changing the shift by ds moves it by ds.
+  //Carried through the remaining folds and the final 1/scale^Iters, the DE changes
+  //by at most da times Folded::reach plus ds times this sum of 1/scale^k.
+  float ShiftReach() const { return shift_reach; }
+
+  //Forward fold steps
+  static void AbsFold(Eigen::Vector3f& p) {
+    p = p.cwiseAbs();
+  }
+  void RotZ(Eigen::Vector3f& p) const {
+    const float rotz_x = rotz_c*p.x() + rotz_s*p.y();
+    const float rotz_y = rotz_c*p.y() - rotz_s*p.x();
+    p.x() = rotz_x; p.y() = rotz_y;
+  }
+  static void MengerFold(Eigen::Vector3f& p) {
+    float a = std::min(p.x() - p.y(), 0.0f);
+    p.x() -= a; p.y() += a;
+    a = std::min(p.x() - p.z(), 0.0f);
+    p.x() -= a; p.z() += a;
+    a = std::min(p.y() - p.z(), 0.0f);
+    p.y() -= a; p.z() += a;
+  }
+  void RotX(Eigen::Vector3f& p) const {
+    const float rotx_y = rotx_c*p.y() + rotx_s*p.z();
+    const float rotx_z = rotx_c*p.z() - rotx_s*p.y();
+    p.y() = rotx_y; p.z() = rotx_z;
+  }
+  void ScaleTrans(Eigen::Vector3f& p) const {
+    p *= scale;
+    p += shift;
+  }
+  void Fold(Eigen::Vector3f& p) const {
+    AbsFold(p);
+    RotZ(p);
+    MengerFold(p);
+    RotX(p);
+    ScaleTrans(p);
+  }
+
+  //Inverse steps, used when unfolding the nearest point
+  void UnScaleTrans(Eigen::Vector3f& n) const {
+    n -= shift;
+    n *= inv_scale;
+  }
+  void UnRotX(Eigen::Vector3f& n) const {
+    const float rotx_y = rotx_c*n.y() - rotx_s*n.z();
+    const float rotx_z = rotx_c*n.z() + rotx_s*n.y();
+    n.y() = rotx_y; n.z() = rotx_z;
+  }
+  void UnRotZ(Eigen::Vector3f& n) const {
+    const float rotz_x = rotz_c*n.x() - rotz_s*n.y();
+    const float rotz_y = rotz_c*n.y() + rotz_s*n.x();
+    n.x() = rotz_x; n.y() = rotz_y;
+  }
+
+  //Forward fold that also records the abs and menger fold decisions
+  void FoldTraced(Eigen::Vector3f& p, unsigned char& bits) const {
+    bits = (p.x() < 0.0f ? NEG_X : 0) | (p.y() < 0.0f ? NEG_Y : 0) | (p.z() < 0.0f ? NEG_Z : 0);
+    AbsFold(p);
+    RotZ(p);
+    const float mx = std::max(p.x(), p.y());
+    if (std::min(p.x(), p.y()) < std::min(mx, p.z())) { bits |= SWAP_YZ; }
+    if (mx < p.z()) { bits |= SWAP_XZ; }
+    if (p.x() < p.y()) { bits |= SWAP_XY; }
+    MengerFold(p);
+    RotX(p);
+    ScaleTrans(p);
+  }
+
+  //Undo one traced iteration on the nearest point
+  void Unfold(Eigen::Vector3f& n, unsigned char bits) const {
+    UnScaleTrans(n);
+    UnRotX(n);
+    if (bits & SWAP_YZ) { std::swap(n.y(), n.z()); }
+    if (bits & SWAP_XZ) { std::swap(n.x(), n.z()); }
+    if (bits & SWAP_XY) { std::swap(n.x(), n.y()); }
+    UnRotZ(n);
+    if (bits & NEG_X) { n.x() = -n.x(); }
+    if (bits & NEG_Y) { n.y() = -n.y(); }
+    if (bits & NEG_Z) { n.z() = -n.z(); }
+  }
+
+  //Distance from a fully folded point to the fractal
+  float BoxDE(const Eigen::Vector3f& p) const {
+    const Eigen::Vector3f a = p.cwiseAbs() - Eigen::Vector3f(6.0f, 6.0f, 6.0f);
+    return (std::min(std::max(std::max(a.x(), a.y()), a.z()), 0.0f) + a.cwiseMax(0.0f).norm()) / w;
+  }
+
+  float DE(const Eigen::Vector3f& pt) const {
+    Eigen::Vector3f p = pt;
+    auto iter = [&](int) { Fold(p); };
+    FractalUnroll<Iters>::Run(iter);
+    return BoxDE(p);
+  }
+
+  //Fold once, then DE() and NP() can both be answered from the result
+  void Fold(const Eigen::Vector3f& pt, Folded& f) const {
+    f.p = pt;
+    f.reach = 0.0f;
+    float inv_w = 1.0f;
+    auto iter = [&](int i) {
+      f.reach += f.p.norm() * inv_w;
+      inv_w *= inv_scale;
+      FoldTraced(f.p, f.bits[i]);
+    };
+    FractalUnroll<Iters>::Run(iter);
+  }
+  float DE(const Folded& f) const {
+    return BoxDE(f.p);
+  }
+  Eigen::Vector3f NP(const Folded& f) const {
+    Eigen::Vector3f n = f.p.cwiseMax(-6.0f).cwiseMin(6.0f);
+    auto iter = [&](int i) { Unfold(n, f.bits[Iters - 1 - i]); };
+    FractalUnroll<Iters>::Run(iter);
+    return n;
+  }
+
+private:
+  void Rebuild(const FractalParams& p) {
+    params = p;
+    scale = p[0];
+    inv_scale = 1.0f / scale;
+    rotz_c = std::cos(p[1]);
+    rotz_s = std::sin(p[1]);
+    rotx_c = std::cos(p[2]);
+    rotx_s = std::sin(p[2]);
+    shift = p.segment<3>(3);
+    w = 1.0f;
+    shift_reach = 0.0f;
+    for (int i = 0; i < Iters; ++i) {
+      w *= scale;
+      shift_reach += 1.0f / w;
+    }
+  }
+
+  FractalParams   params;
+  float           scale;
+  float           inv_scale;
+  float           shift_reach;
+  float           rotz_c;
+  float           rotz_s;
+  float           rotx_c;
+  float           rotx_s;
+  Eigen::Vector3f shift;
+  float           w;
+};
@@ -0,0 +1,124 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+void WaitUntil(std::chrono::steady_clock::time_point deadline) {
+  typedef std::chrono::steady_clock Clock;
+
+  //Sleeping can overshoot by a millisecond or more, so stop short and spin
+  const Clock::duration spin = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<float>(frame_spin_time));
+  const Clock::time_point now = Clock::now();
+  if (deadline - now > spin) {
+    sf::sleep(sf::seconds(std::chrono::duration<float>(deadline - spin - now).count()));
+  }
+  while (Clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
+
+FrameScheduler::FrameScheduler() :
+  mode(VSYNC),
+  fixed_fps(default_refresh_rate),
+  refresh_rate(default_refresh_rate),
+  presented(false),
+  num_intervals(0),
+  next_interval(0) {
+  stats.fps = default_refresh_rate;
+  stats.mean = 1.0f / default_refresh_rate;
+  stats.jitter = 0.0f;
+  stats.worst = 1.0f / default_refresh_rate;
+}
+
+void FrameScheduler::SetMode(sf::Window& window, Mode _mode, float fps) {
+  mode = _mode;
+  fixed_fps = std::max(fps, 1.0f);
+  window.setVerticalSyncEnabled(mode == VSYNC);
+
+  //Old samples were taken at a different pace
+  presented = false;
+  num_intervals = 0;
+  next_interval = 0;
+}
+
+float FrameScheduler::GetFrameTime() const {
+  if (mode == FIXED) {
+    return 1.0f / fixed_fps;
+  }
+  return 1.0f / refresh_rate;
+}
+
+void FrameScheduler::Present(sf::Window& window) {
+  if (mode == FIXED && presented) {
+    //Step the deadline, not the clock, so waits don't drift. A frame that
+    //ran a whole period late starts a new schedule instead of rushing.
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<float>(1.0f / fixed_fps));
+    deadline += period;
+    const Clock::time_point now = Clock::now();
+    if (now > deadline + period) {
+      deadline = now;
+    }
+    WaitUntil(deadline);
+  }
+  window.display();
+
+  const Clock::time_point now = Clock::now();
+  if (presented) {
+    intervals[next_interval] = std::chrono::duration<float>(now - last_present).count();
+    next_interval = (next_interval + 1) % frame_stats_len;
+    num_intervals = std::min(num_intervals + 1, frame_stats_len);
+    UpdateStats();
+  } else {
+    deadline = now;
+  }
+  last_present = now;
+  presented = true;
+}
+
+void FrameScheduler::UpdateStats() {
+  float sum = 0.0f;
+  float worst = 0.0f;
+  for (int i = 0; i < num_intervals; ++i) {
+    sum += intervals[i];
+    worst = std::max(worst, intervals[i]);
+  }
+  const float mean = sum / float(num_intervals);
+  float var = 0.0f;
+  for (int i = 0; i < num_intervals; ++i) {
+    var += (intervals[i] - mean) * (intervals[i] - mean);
+  }
+  stats.mean = mean;
+  stats.fps = (mean > 0.0f ? 1.0f / mean : 0.0f);
+  stats.jitter = std::sqrt(var / float(num_intervals));
+  stats.worst = worst;
+
+  //With V-Sync most presents are exactly one refresh apart. The median
+  //ignores the frames that missed one, once a full window has been seen.
+  if (mode == VSYNC && num_intervals == frame_stats_len && next_interval == 0) {
+    float sorted[frame_stats_len];
+    std::copy(intervals, intervals + frame_stats_len, sorted);
+    std::nth_element(sorted, sorted + frame_stats_len / 2, sorted + frame_stats_len);
+    const float median = sorted[frame_stats_len / 2];
+    if (median * max_refresh_rate >= 1.0f) {
+      refresh_rate = 1.0f / median;
+    }
+  }
+}
@@ -0,0 +1,83 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <SFML/Window.hpp>
+#include <chrono>
+
+static const int frame_stats_len = 120;           //Presents the timing stats cover
+static const float frame_spin_time = 0.002f;      //Busy wait this long before a deadline, sleep until then
+static const float default_refresh_rate = 60.0f;  //Assumed until V-Sync has been measured
+static const float max_refresh_rate = 240.0f;     //Faster V-Synced presents mean the driver ignores V-Sync
+
+//Sleeps for most of the time until deadline and busy waits the rest, which
+//is much more precise than sleeping alone
+void WaitUntil(std::chrono::steady_clock::time_point deadline);
+
+//Present-to-present timing over the last frame_stats_len frames
+struct FrameStats {
+  float fps;     //Average frames per second
+  float mean;    //Average time between presents
+  float jitter;  //Standard deviation of the time between presents
+  float worst;   //Longest time between presents
+};
+
+//Decides when frames are shown. It either lets V-Sync pace them, shows them
+//as soon as they are done, or holds them to a fixed rate with WaitUntil.
+//The refresh rate of the display is measured from the time between V-Synced
+//presents.
+class FrameScheduler {
+public:
+  enum Mode {
+    UNCAPPED,
+    VSYNC,
+    FIXED,
+  };
+
+  FrameScheduler();
+
+  //FIXED mode shows fps frames per second, the others ignore it
+  void SetMode(sf::Window& window, Mode mode, float fps = default_refresh_rate);
+  Mode GetMode() const { return mode; }
+
+  //Waits until the frame is due, then displays the window
+  void Present(sf::Window& window);
+
+  //Measured refresh rate of the display
+  float GetRefreshRate() const { return refresh_rate; }
+
+  //Time each frame has to render in to keep up with the current mode
+  float GetFrameTime() const;
+
+  const FrameStats& GetStats() const { return stats; }
+
+protected:
+  void UpdateStats();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  Mode              mode;
+  float             fixed_fps;
+  float             refresh_rate;
+  Clock::time_point deadline;
+  Clock::time_point last_present;
+  bool              presented;
+  float             intervals[frame_stats_len];
+  int               num_intervals;
+  int               next_interval;
+  FrameStats        stats;
+};
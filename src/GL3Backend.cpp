@@ -0,0 +1,187 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "GL3Backend.h"
+#include "Res.h"
+#include <SFML/OpenGL.hpp>
+#include <cstddef>
+#include <cstring>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+//Missing from the GL 1.1 headers some platforms ship
+static const GLenum gl_uniform_buffer = 0x8A11;
+static const GLenum gl_dynamic_draw = 0x88E8;
+static const GLenum gl_read_framebuffer = 0x8CA8;
+static const GLenum gl_color_attachment0 = 0x8CE0;
+static const GLuint gl_invalid_index = 0xFFFFFFFFu;
+
+//GL 3.3 entry points, loaded at runtime since SFML only links GL 1.1
+struct GL3Functions {
+  void (APIENTRY *GenVertexArrays)(GLsizei n, GLuint* arrays);
+  void (APIENTRY *BindVertexArray)(GLuint array);
+  void (APIENTRY *GenBuffers)(GLsizei n, GLuint* buffers);
+  void (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+  void (APIENTRY *BufferData)(GLenum target, std::ptrdiff_t size, const void* data, GLenum usage);
+  void (APIENTRY *BufferSubData)(GLenum target, std::ptrdiff_t offset, std::ptrdiff_t size, const void* data);
+  void (APIENTRY *BindBufferBase)(GLenum target, GLuint index, GLuint buffer);
+  GLuint (APIENTRY *GetUniformBlockIndex)(GLuint program, const char* name);
+  void (APIENTRY *UniformBlockBinding)(GLuint program, GLuint index, GLuint binding);
+  void (APIENTRY *GenFramebuffers)(GLsizei n, GLuint* framebuffers);
+  void (APIENTRY *BindFramebuffer)(GLenum target, GLuint framebuffer);
+  void (APIENTRY *FramebufferTexture2D)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+  void (APIENTRY *BlitFramebuffer)(GLint src_x0, GLint src_y0, GLint src_x1, GLint src_y1,
+                                   GLint dst_x0, GLint dst_y0, GLint dst_x1, GLint dst_y1, GLbitfield mask, GLenum filter);
+};
+static GL3Functions gl;
+
+bool gl3_enabled = false;
+
+template <typename T>
+static bool LoadFunction(T& func, const char* name) {
+  func = reinterpret_cast<T>(sf::Context::getFunction(name));
+  return func != nullptr;
+}
+
+static bool LoadFunctions() {
+  return LoadFunction(gl.GenVertexArrays, "glGenVertexArrays") &&
+         LoadFunction(gl.BindVertexArray, "glBindVertexArray") &&
+         LoadFunction(gl.GenBuffers, "glGenBuffers") &&
+         LoadFunction(gl.BindBuffer, "glBindBuffer") &&
+         LoadFunction(gl.BufferData, "glBufferData") &&
+         LoadFunction(gl.BufferSubData, "glBufferSubData") &&
+         LoadFunction(gl.BindBufferBase, "glBindBufferBase") &&
+         LoadFunction(gl.GetUniformBlockIndex, "glGetUniformBlockIndex") &&
+         LoadFunction(gl.UniformBlockBinding, "glUniformBlockBinding") &&
+         LoadFunction(gl.GenFramebuffers, "glGenFramebuffers") &&
+         LoadFunction(gl.BindFramebuffer, "glBindFramebuffer") &&
+         LoadFunction(gl.FramebufferTexture2D, "glFramebufferTexture2D") &&
+         LoadFunction(gl.BlitFramebuffer, "glBlitFramebuffer");
+}
+
+bool LoadFractalShader(sf::Shader& shader, const ShaderDefines& defines) {
+  if (!gl3_enabled) {
+    return LoadShaderVariant(shader, vert_glsl, frag_glsl, defines);
+  }
+  ShaderDefines gl3_defines = defines;
+  gl3_defines["SCENE_BLOCK"] = "1";
+  return LoadShaderVariant(shader, vert3_glsl, frag_glsl, gl3_defines, "330 compatibility");
+}
+
+GL3Backend::GL3Backend() :
+  scene_valid(false),
+  vao(0),
+  ubo(0),
+  read_fbo(0) {
+}
+
+bool GL3Backend::Create(sf::RenderWindow& window) {
+  const sf::ContextSettings& settings = window.getSettings();
+  if (settings.majorVersion * 10 + settings.minorVersion < 33) {
+    return false;
+  }
+  if ((settings.attributeFlags & sf::ContextSettings::Core) != 0) {
+    return false;
+  }
+  if (!window.setActive(true) || !LoadFunctions()) {
+    return false;
+  }
+
+  //Vertex arrays and framebuffers aren't shared between contexts, so all of
+  //the drawing has to happen in the window's
+  gl.GenVertexArrays(1, &vao);
+  gl.GenFramebuffers(1, &read_fbo);
+  gl.GenBuffers(1, &ubo);
+  gl.BindBuffer(gl_uniform_buffer, ubo);
+  gl.BufferData(gl_uniform_buffer, sizeof(SceneBlock), nullptr, gl_dynamic_draw);
+  gl.BindBuffer(gl_uniform_buffer, 0);
+  gl.BindBufferBase(gl_uniform_buffer, scene_block_binding, ubo);
+  scene_valid = false;
+  gl3_enabled = true;
+  return true;
+}
+
+void GL3Backend::SetScene(const SceneUniforms& frame) {
+  SceneBlock block;
+  std::memset(&block, 0, sizeof(block));
+  std::memcpy(block.mat, frame.cam_mat.data(), sizeof(block.mat));
+  std::memcpy(block.marble_pos, frame.marble_pos.data(), sizeof(block.marble_pos));
+  block.marble_rad = frame.marble_rad;
+  std::memcpy(block.flag_pos, frame.flag_pos.data(), sizeof(block.flag_pos));
+  block.flag_scale = frame.flag_scale;
+  block.frac_scale = frame.frac_params[0];
+  block.frac_ang1 = frame.frac_params[1];
+  block.frac_ang2 = frame.frac_params[2];
+  std::memcpy(block.frac_shift, frame.frac_params.data() + 3, sizeof(block.frac_shift));
+  std::memcpy(block.frac_col, frame.frac_params.data() + 6, sizeof(block.frac_col));
+  block.exposure = frame.exposure;
+
+  //Menus and paused frames don't change anything
+  if (scene_valid && std::memcmp(&block, &scene, sizeof(block)) == 0) {
+    return;
+  }
+  scene = block;
+  scene_valid = true;
+  gl.BindBuffer(gl_uniform_buffer, ubo);
+  gl.BufferSubData(gl_uniform_buffer, 0, sizeof(SceneBlock), &scene);
+  gl.BindBuffer(gl_uniform_buffer, 0);
+}
+
+void GL3Backend::Draw(sf::Shader& shader, sf::RenderTexture& target, unsigned int width, unsigned int height) {
+  //Binds the texture's framebuffer in the window's context
+  target.setActive(true);
+
+  //Each program only needs to be pointed at the buffer once
+  const unsigned int program = shader.getNativeHandle();
+  if (programs.insert(program).second) {
+    const GLuint block = gl.GetUniformBlockIndex(program, "SceneBlock");
+    if (block != gl_invalid_index) {
+      gl.UniformBlockBinding(program, block, scene_block_binding);
+    }
+  }
+
+  //Alpha holds depth, so it must not blend. SFML expects blending to stay on.
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  glDisable(GL_BLEND);
+  glViewport(0, 0, width, height);
+  sf::Shader::bind(&shader);
+  gl.BindVertexArray(vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  gl.BindVertexArray(0);
+  sf::Shader::bind(nullptr);
+  if (blend) {
+    glEnable(GL_BLEND);
+  }
+  target.display();
+}
+
+void GL3Backend::Blit(const sf::Texture& source, unsigned int width, unsigned int height, sf::RenderTarget& target) {
+  //Activating the window binds its own framebuffer for drawing
+  target.setActive(true);
+  const sf::Vector2u size = target.getSize();
+  gl.BindFramebuffer(gl_read_framebuffer, read_fbo);
+  gl.FramebufferTexture2D(gl_read_framebuffer, gl_color_attachment0, GL_TEXTURE_2D, source.getNativeHandle(), 0);
+  gl.BlitFramebuffer(0, 0, width, height, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  gl.BindFramebuffer(gl_read_framebuffer, 0);
+
+  //The blit copied depth into the window's alpha, it has to stay opaque
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
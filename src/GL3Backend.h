@@ -0,0 +1,77 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "SceneUniforms.h"
+#include "ShaderVariant.h"
+#include <SFML/Graphics.hpp>
+#include <set>
+
+static const unsigned int scene_block_binding = 0;  //Uniform buffer binding point of the scene values
+
+//Set once the GL 3.3 backend is running, fractal shaders are compiled for it
+extern bool gl3_enabled;
+
+//Compiles a variant of the fractal shader for whichever backend is running
+bool LoadFractalShader(sf::Shader& shader, const ShaderDefines& defines);
+
+//The std140 layout of the SceneBlock uniform block in frag.glsl
+struct SceneBlock {
+  float mat[16];
+  float marble_pos[3];
+  float marble_rad;
+  float flag_pos[3];
+  float flag_scale;
+  float frac_shift[3];
+  float frac_scale;
+  float frac_col[3];
+  float frac_ang1;
+  float frac_ang2;
+  float exposure;
+  float padding[2];
+};
+
+//Draws the fractal passes with less driver work than going through SFML. A
+//single triangle covers the viewport instead of a rebuilt quad, the scene
+//values come from a uniform buffer that is only written when they change,
+//and the final frame is blitted to the window instead of drawn as a sprite.
+//It needs a GL 3.3 compatibility context, since SFML still draws the menus
+//with the fixed function pipeline.
+class GL3Backend {
+public:
+  GL3Backend();
+
+  //Loads the GL 3.3 functions and creates the buffers in the window's
+  //context. False if the context is too old, then nothing should use it.
+  bool Create(sf::RenderWindow& window);
+
+  //Uploads the scene values if they differ from the last frame's
+  void SetScene(const SceneUniforms& frame);
+
+  //Runs shader over the bottom left width x height corner of target
+  void Draw(sf::Shader& shader, sf::RenderTexture& target, unsigned int width, unsigned int height);
+
+  //Stretches the bottom left width x height corner of source over target
+  void Blit(const sf::Texture& source, unsigned int width, unsigned int height, sf::RenderTarget& target);
+
+private:
+  SceneBlock              scene;
+  bool                    scene_valid;
+  std::set<unsigned int>  programs;
+  unsigned int            vao;
+  unsigned int            ubo;
+  unsigned int            read_fbo;
+};
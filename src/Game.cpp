@@ -38,42 +38,21 @@ int dirExists(const char *path) {
 }
 
 int Game::init(){
+    //Map the asset pack next to the executable, if there is one
+    OpenResPack();
+
     //Make sure shader is supported
     if (!sf::Shader::isAvailable()) {
       ERROR_MSG("Graphics card does not support shaders");
       return 1;
     }
-    //Load the vertex shader
-    if (!shader.loadFromFile(vert_glsl, sf::Shader::Vertex)) {
-      ERROR_MSG("Failed to compile vertex shader");
-      return 1;
-    }
-    //Load the fragment shader
-    if (!shader.loadFromFile(frag_glsl, sf::Shader::Fragment)) {
-      ERROR_MSG("Failed to compile fragment shader");
-      return 1;
-    }
-
-    //Load the font
-    if (!font.loadFromFile(Orbitron_Bold_ttf)) {
-      ERROR_MSG("Unable to load font");
-      return 1;
-    }
-    //Load the mono font
-    if (!font_mono.loadFromFile(Inconsolata_Bold_ttf)) {
-      ERROR_MSG("Unable to load mono font");
-      return 1;
-    }
-
-    //Load the music
-    menu_music.openFromFile(menu_ogg);
-    menu_music.setLoop(true);
-    level1_music.openFromFile(level1_ogg);
-    level1_music.setLoop(true);
-    level2_music.openFromFile(level2_ogg);
-    level2_music.setLoop(true);
-    credits_music.openFromFile(credits_ogg);
-    credits_music.setLoop(true);
+    //Start loading the fonts and music in the background
+    font.Load(Orbitron_Bold_ttf);
+    font_mono.Load(Inconsolata_Bold_ttf);
+    menu_music.Load(menu_ogg);
+    level1_music.Load(level1_ogg);
+    level2_music.Load(level2_ogg);
+    credits_music.Load(credits_ogg);
 
     //Get the directory for saving and loading high scores
   #ifdef _WIN32
@@ -98,25 +77,38 @@ int Game::init(){
     //Load scores if available
     high_scores.Load(save_file);
 
+    //Load the render quality
+    LoadQuality(save_dir + "/quality.bin");
+
     return 0;
 }
 
+void Game::set_frame_mode(FrameScheduler::Mode mode, float fps){
+    frame_mode = mode;
+    frame_cap = fps;
+}
+
 const Resolution* Game::get_resolution(){
-    SelectRes select_res(&font_mono);
+    //The resolution picker only needs the mono font
+    if (!font_mono.Wait()) {
+      ERROR_MSG("Unable to load mono font");
+      return nullptr;
+    }
+    SelectRes select_res(&font_mono.Get());
     const Resolution* resolution = select_res.Run();
     fullscreen = select_res.FullScreen();
 	 return resolution;
 }
 
-int Game::run(const Resolution* resolution){
+int Game::run(const Resolution* resolution, bool use_gl3){
     //Have user select the resolution
 	 if (resolution == nullptr) {
       return 0;
     }
 
-    //GL settings
-    settings.majorVersion = 2;
-    settings.minorVersion = 0;
+    //GL settings, the GL 3.3 backend still needs the compatibility profile
+    settings.majorVersion = (use_gl3 ? 3 : 2);
+    settings.minorVersion = (use_gl3 ? 3 : 0);
 
     //Create the window
     const sf::Vector2i screen_center(resolution->width / 2, resolution->height / 2);
@@ -128,46 +120,62 @@ int Game::run(const Resolution* resolution){
       window_style = sf::Style::Close;
     }
     sf::RenderWindow window(screen_size, "Marble Marcher", window_style, settings);
-    window.setVerticalSyncEnabled(true);
+    scheduler.SetMode(window, frame_mode, frame_cap);
     window.setKeyRepeatEnabled(false);
     window.requestFocus();
 
-    //If native resolution is the same, then we don't need a render texture
-    if (resolution->width == screen_size.width && resolution->height == screen_size.height) {
-      fullscreen = false;
+    //Render at up to the selected resolution, scaled down when frames take too long
+    DynamicRes dyn_res;
+    if (!dyn_res.Create(resolution->width, resolution->height, settings)) {
+      ERROR_MSG("Failed to create render texture");
+      return 1;
     }
 
-    //Create the render texture if needed
-    sf::RenderTexture renderTexture;
-    if (fullscreen) {
-      renderTexture.create(resolution->width, resolution->height, settings);
-      renderTexture.setSmooth(true);
-      renderTexture.setActive(true);
-      window.setActive(false);
+    //Use the GL 3.3 backend if asked for and the driver has it
+    GL3Backend gl3;
+    if (use_gl3 && gl3.Create(window)) {
+      dyn_res.SetBackend(&gl3);
+    }
+
+    //Compile the fractal shader for every preset in the window's context
+    window.setActive(true);
+    if (!CompileQualityShaders(shader_cache, quality_shaders)) {
+      ERROR_MSG("Failed to compile fractal shader");
+      return 1;
+    }
+    window.setActive(false);
+
+    //Everything else has had the resolution picker and shader compile to load
+    if (!font.Wait()) {
+      ERROR_MSG("Unable to load font");
+      return 1;
     }
+    menu_music.Wait();
+    menu_music->setLoop(true);
+    level1_music.Wait();
+    level1_music->setLoop(true);
+    level2_music.Wait();
+    level2_music->setLoop(true);
+    credits_music.Wait();
+    credits_music->setLoop(true);
 
     //Create the fractal scene
-    Scene scene(&level1_music, &level2_music);
-    const sf::Glsl::Vec2 window_res((float)resolution->width, (float)resolution->height);
-    shader.setUniform("iResolution", window_res);
-    scene.Write(shader);
+    Scene scene(&level1_music.Get(), &level2_music.Get());
 
     //Create the menus
-    Overlays overlays(&font, &font_mono);
+    Overlays overlays(&font.Get(), &font_mono.Get());
     overlays.SetScale(float(screen_size.width) / 1280.0f);
-    menu_music.setVolume(GetVol());
-    menu_music.play();
+    menu_music->setVolume(GetVol());
+    menu_music->play();
 
     //Main loop
-    smooth_fps = 60.0f;
-    lag_ms = 0;
-    loop(resolution, window, renderTexture, screen_center, scene, overlays, window_res);
+    loop(window, dyn_res, screen_center, scene, overlays);
 
     //Stop all music
-    menu_music.stop();
-    level1_music.stop();
-    level2_music.stop();
-    credits_music.stop();
+    menu_music->stop();
+    level1_music->stop();
+    level2_music->stop();
+    credits_music->stop();
 
     //Get the directory for saving and loading high scores
   #ifdef _WIN32
@@ -178,6 +186,7 @@ int Game::run(const Resolution* resolution){
 
     const std::string save_file = save_dir + "/scores.bin";
     high_scores.Save(save_file);
+    SaveQuality(save_dir + "/quality.bin");
 
   #ifdef _DEBUG
     system("pause");
@@ -187,7 +196,7 @@ int Game::run(const Resolution* resolution){
 
 void Game::main_menu_event_Play(sf::RenderWindow& window, Scene &scene){
 				game_mode = PLAYING;
-            menu_music.stop();
+            menu_music->stop();
             scene.StartNewGame();
             scene.GetCurMusic().setVolume(GetVol());
             scene.GetCurMusic().play();
@@ -252,7 +261,7 @@ void Game::playing_event(sf::Event& event, sf::RenderWindow& window, Scene& scen
       const sf::Keyboard::Key keycode = event.key.code;
       if (event.key.code < 0 || event.key.code >= sf::Keyboard::KeyCount) { return; }
       if (keycode == sf::Keyboard::Escape) {
-			pause(window, scene)
+			pause(window, scene);
 
      }else if (keycode == sf::Keyboard::R) {
           scene.ResetLevel();
@@ -309,16 +318,16 @@ void Game::paused_event_MousePressedLeft_Quit(sf::RenderWindow& window, Scene& s
             }
             scene.SetMode(Scene::INTRO);
             scene.StopAllMusic();
-            menu_music.setVolume(GetVol());
-            menu_music.play();
+            menu_music->setVolume(GetVol());
+            menu_music->play();
 }
 
 
 // Test this func
 void Game::paused_event_MousePressedLeft_Music(sf::RenderWindow& window, Scene& scene, Overlays &overlays){
 				music_on = !music_on;
-            level1_music.setVolume(GetVol());
-            level2_music.setVolume(GetVol());
+            level1_music->setVolume(GetVol());
+            level2_music->setVolume(GetVol());
 }
 
 
@@ -337,7 +346,7 @@ void Game::paused_event(sf::Event& event, sf::RenderWindow& window, Scene& scene
     }else if (event.type == sf::Event::MouseButtonPressed) {
         if (event.mouseButton.button == sf::Mouse::Left) {
           mouse_pos = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
-          const Overlays::Texts selected = overlays.GetOption(Overlays::CONTINUE, Overlays::MOUSE);
+          const Overlays::Texts selected = overlays.GetOption(Overlays::CONTINUE, Overlays::QUALITY);
           if (selected == Overlays::CONTINUE) {
 					paused_event_MousePressedLeft_Continue(window, scene, overlays);
 		    } else if (selected == Overlays::RESTART) {
@@ -349,6 +358,8 @@ void Game::paused_event(sf::Event& event, sf::RenderWindow& window, Scene& scene
 					paused_event_MousePressedLeft_Music(window, scene, overlays);
 			} else if (selected == Overlays::MOUSE) {
             mouse_setting = (mouse_setting + 1) % 3;
+          } else if (selected == Overlays::QUALITY) {
+            NextQuality(quality_shaders);
           }
 		}
 
@@ -426,7 +437,7 @@ void Game::choose_level(sf::RenderWindow &window, Scene &scene, const Overlays::
           } else if (selected >= Overlays::L0 && selected <= Overlays::L14) {
             if (high_scores.HasUnlocked(selected - Overlays::L0)) {
               game_mode = PLAYING;
-              menu_music.stop();
+              menu_music->stop();
               scene.SetExposure(1.0f);
               scene.StartSingle(selected - Overlays::L0);
               scene.GetCurMusic().setVolume(GetVol());
@@ -472,9 +483,9 @@ void Game::credits_event(sf::Event& event, sf::RenderWindow& window, Scene& scen
       UnlockMouse(window);
       scene.SetMode(Scene::INTRO);
       scene.SetExposure(1.0f);
-      credits_music.stop();
-      menu_music.setVolume(GetVol());
-      menu_music.play();
+      credits_music->stop();
+      menu_music->setVolume(GetVol());
+      menu_music->play();
       all_keys[keycode] = true;
     }else if (event.type == sf::Event::KeyReleased) {
         const sf::Keyboard::Key keycode = event.key.code;
@@ -513,17 +524,33 @@ void Game::handleEvent(sf::Event& event, sf::RenderWindow& window, Scene& scene,
     }
 }
 
-void Game::gameUpdate(Scene& scene, Overlays& overlays, const sf::Vector2i& screen_center, sf::RenderWindow& window){
+void Game::updateInput(Scene& scene, Overlays& overlays, const sf::Vector2i& screen_center, sf::RenderWindow& window){
+    //Check if the game was beat
+    if (scene.GetMode() == Scene::FINAL && game_mode != CREDITS) {
+      game_mode = CREDITS;
+      scene.StopAllMusic();
+      scene.SetExposure(0.5f);
+      credits_music->play();
+    }
+
+    //Menus follow the mouse, the camera gets however far it moved by the next tick
     if (game_mode == MAIN_MENU) {
-      scene.UpdateCamera();
       overlays.UpdateMenu((float)mouse_pos.x, (float)mouse_pos.y);
     } else if (game_mode == CONTROLS) {
-      scene.UpdateCamera();
       overlays.UpdateControls((float)mouse_pos.x, (float)mouse_pos.y);
     } else if (game_mode == LEVELS) {
-      scene.UpdateCamera();
       overlays.UpdateLevels((float)mouse_pos.x, (float)mouse_pos.y);
-    } else if (game_mode == SCREEN_SAVER) {
+    } else if (game_mode == PLAYING || game_mode == CREDITS) {
+      mouse_delta += mouse_pos - screen_center;
+      sf::Mouse::setPosition(screen_center, window);
+      mouse_pos = screen_center;
+    } else if (game_mode == PAUSED) {
+      overlays.UpdatePaused((float)mouse_pos.x, (float)mouse_pos.y);
+    }
+}
+
+void Game::gameUpdate(Scene& scene){
+    if (game_mode == MAIN_MENU || game_mode == CONTROLS || game_mode == LEVELS || game_mode == SCREEN_SAVER) {
       scene.UpdateCamera();
     } else if (game_mode == PLAYING || game_mode == CREDITS) {
       //Collect keyboard input
@@ -535,8 +562,6 @@ void Game::gameUpdate(Scene& scene, Overlays& overlays, const sf::Vector2i& scre
         (all_keys[sf::Keyboard::Up] || all_keys[sf::Keyboard::W] ? 1.0f : 0.0f);
 
       //Collect mouse input
-      const sf::Vector2i mouse_delta = mouse_pos - screen_center;
-      sf::Mouse::setPosition(screen_center, window);
       float ms = mouse_sensitivity;
       if (mouse_setting == 1) {
         ms *= 0.5f;
@@ -546,16 +571,16 @@ void Game::gameUpdate(Scene& scene, Overlays& overlays, const sf::Vector2i& scre
       const float cam_lr = float(-mouse_delta.x) * ms;
       const float cam_ud = float(-mouse_delta.y) * ms;
       const float cam_z = mouse_wheel * wheel_sensitivity;
+      mouse_delta = sf::Vector2i(0, 0);
 
       //Apply forces to marble and camera
       scene.UpdateMarble(force_lr, force_ud);
       scene.UpdateCamera(cam_lr, cam_ud, cam_z);
-    } else if (game_mode == PAUSED) {
-      overlays.UpdatePaused((float)mouse_pos.x, (float)mouse_pos.y);
     }
+    mouse_wheel = 0.0f;
 }
 
-void Game::updateOverlays(Overlays& overlays, sf::RenderWindow& window, Scene& scene){
+void Game::updateOverlays(Overlays& overlays, sf::RenderWindow& window, const SceneSnapshot& snapshot){
     if (game_mode == MAIN_MENU) {
       overlays.DrawMenu(window);
     } else if (game_mode == CONTROLS) {
@@ -563,24 +588,32 @@ void Game::updateOverlays(Overlays& overlays, sf::RenderWindow& window, Scene& s
     } else if (game_mode == LEVELS) {
       overlays.DrawLevels(window);
     } else if (game_mode == PLAYING) {
-      if (scene.GetMode() == Scene::ORBIT && scene.GetMarble().x() < 998.0f) {
-        overlays.DrawLevelDesc(window, scene.GetLevel());
-      } else if (scene.GetMode() == Scene::MARBLE) {
-        overlays.DrawArrow(window, scene.GetGoalDirection());
+      if (snapshot.cam_mode == Scene::ORBIT && snapshot.marble_pos.x() < 998.0f) {
+        overlays.DrawLevelDesc(snapshot.level);
+      } else if (snapshot.cam_mode == Scene::MARBLE) {
+        overlays.DrawArrow(snapshot.goal_direction);
       }
-      overlays.DrawTimer(window, scene.GetCountdownTime(), scene.IsHighScore());
+      overlays.DrawTimer(snapshot.countdown_time, snapshot.high_score);
     } else if (game_mode == PAUSED) {
       overlays.DrawPaused(window);
     } else if (game_mode == CREDITS) {
       overlays.DrawCredits(window);
     }
-    overlays.DrawFPS(window, int(smooth_fps + 0.5f));
+    overlays.DrawFPS(int(scheduler.GetStats().fps + 0.5f));
+    overlays.DrawHud(window);
 }
 
-void Game::loop(const Resolution* resolution, sf::RenderWindow& window, sf::RenderTexture& renderTexture, const sf::Vector2i& screen_center, Scene& scene, Overlays& overlays, const sf::Glsl::Vec2& window_res){
+void Game::loop(sf::RenderWindow& window, DynamicRes& dyn_res, const sf::Vector2i& screen_center, Scene& scene, Overlays& overlays){
+    //Physics and game state run on their own thread in fixed ticks, input is
+    //gathered here and handed over while holding the simulation's lock
+    mouse_delta = sf::Vector2i(0, 0);
+    mouse_wheel = 0.0f;
+    SimThread sim(scene, tick_rate, max_frame_time, [&]() { gameUpdate(scene); });
+    sim.Start();
     while (window.isOpen()) {
+      //Events change the game state the ticks read
+      std::unique_lock<std::mutex> sim_lock(sim.GetMutex());
       sf::Event event;
-      mouse_wheel = 0.0f;
       while (window.pollEvent(event)) {
           if (event.type == sf::Event::Closed) {
             window.close();
@@ -590,67 +623,30 @@ void Game::loop(const Resolution* resolution, sf::RenderWindow& window, sf::Rend
               handleEvent(event, window, scene, overlays);
           }
       }
-      //Check if the game was beat
-      if (scene.GetMode() == Scene::FINAL && game_mode != CREDITS) {
-        game_mode = CREDITS;
-        scene.StopAllMusic();
-        scene.SetExposure(0.5f);
-        credits_music.play();
-      }
-      gameUpdate(scene, overlays, screen_center, window);
-
-      bool skip_frame = false;
-      if (lag_ms >= 16) {
-        //If there is too much lag, just do another frame of physics and skip the draw
-        lag_ms -= 16;
-        skip_frame = true;
-      } else {
-        //Update the shader values
-        scene.Write(shader);
-
-        //Setup full-screen shader
-        sf::RenderStates states = sf::RenderStates::Default;
-        states.shader = &shader;
-        sf::RectangleShape rect;
-        rect.setSize(window_res);
-        rect.setPosition(0, 0);
-
-        //Draw the fractal
-        if (fullscreen) {
-          //Draw to the render texture
-          renderTexture.draw(rect, states);
-          renderTexture.display();
-
-          //Draw render texture to main window
-          sf::Sprite sprite(renderTexture.getTexture());
-          sprite.setScale(float(screen_size.width) / float(resolution->width),
-                          float(screen_size.height) / float(resolution->height));
-          window.draw(sprite);
-        } else {
-          //Draw directly to the main window
-          window.draw(rect, states);
-        }
-      }
 
-      //Draw text overlays to the window
-      updateOverlays(overlays, window, scene);
+      updateInput(scene, overlays, screen_center, window);
+      sim_lock.unlock();
 
-      if (!skip_frame) {
-        //Finally display to the screen
-        window.display();
+      //Blend the newest snapshot between its last two ticks and pick the shaders of the current
+      //quality preset, using the level's baked shaders once they are compiled
+      sim.Update();
+      const SceneSnapshot& snapshot = sim.GetSnapshot();
+      SceneUniforms frame;
+      snapshot.GetFrameUniforms(frame, sim.GetAlpha());
+      QualityShaders quality = quality_shaders[quality_setting];
+      baked_shaders.Get(snapshot.level, quality_setting, frame.frac_params, quality);
+      sf::Shader& shader = *quality.main;
+      dyn_res.SetPasses(quality.cone, quality.shadow, quality.baked);
 
-        //If V-Sync is running higher than desired fps, slow down!
-        const float s = clock.restart().asSeconds();
-        if (s > 0.0f) {
-          smooth_fps = smooth_fps*0.9f + std::min(1.0f / s, 60.0f)*0.1f;
-        }
-        const int time_diff_ms = int(16.66667f - s*1000.0f);
-        if (time_diff_ms > 0) {
-          sf::sleep(sf::milliseconds(time_diff_ms));
-          lag_ms = std::max(lag_ms - time_diff_ms, 0);
-        } else if (time_diff_ms < 0) {
-          lag_ms += std::max(-time_diff_ms, 0);
-        }
-      }
+      //Draw the fractal, in whatever time the display leaves for it
+      dyn_res.SetFrameTime(scheduler.GetFrameTime());
+      dyn_res.Draw(shader, window, frame);
+
+      //Draw text overlays to the window
+      updateOverlays(overlays, window, snapshot);
+
+      //Finally display to the screen when the frame is due, physics runs at tick_rate regardless
+      scheduler.Present(window);
     }
+    sim.Stop();
 }
@@ -1,9 +1,16 @@
 #pragma once
 #include "Scene.h"
+#include "AssetLoader.h"
+#include "BakedShaders.h"
+#include "DynamicRes.h"
+#include "FrameScheduler.h"
+#include "GL3Backend.h"
 #include "Level.h"
 #include "Overlays.h"
+#include "Quality.h"
 #include "Res.h"
 #include "SelectRes.h"
+#include "SimThread.h"
 #include "Scores.h"
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
@@ -29,6 +36,8 @@ enum GameMode {
 static const float mouse_sensitivity = 0.005f;
 static const float wheel_sensitivity = 0.2f;
 static const float music_vol = 75.0f;
+static const float tick_rate = 60.0f;      //Fixed simulation rate all game constants are tuned for
+static const float max_frame_time = 0.25f; //Drop time beyond this instead of simulating it
 
 static sf::Vector2i mouse_pos;
 static bool all_keys[sf::Keyboard::KeyCount] = { 0 };
@@ -37,9 +46,10 @@ static GameMode game_mode = MAIN_MENU;
 
 class Game{
 public:
-    int run(const Resolution *);
+    int run(const Resolution *, bool use_gl3 = false);
+    void set_frame_mode(FrameScheduler::Mode mode, float fps = default_refresh_rate);
     int init();
-    void loop(const Resolution* resolution, sf::RenderWindow& window, sf::RenderTexture& renderTexture, const sf::Vector2i& screen_center, Scene& scene, Overlays& overlays, const sf::Glsl::Vec2& window_res);
+    void loop(sf::RenderWindow& window, DynamicRes& dyn_res, const sf::Vector2i& screen_center, Scene& scene, Overlays& overlays);
 
 	 void paused_event_Escape(sf::RenderWindow&, Scene&, Overlays&);
 	 void paused_event_MousePressedLeft_Continue(sf::RenderWindow&, Scene&, Overlays&);
@@ -62,23 +72,27 @@ protected:
     void controls_event(sf::Event& event, Scene& scene, Overlays& overlays);
     void levels_event(sf::Event& event, sf::RenderWindow& window, Scene& scene, Overlays& overlays);
     void credits_event(sf::Event& event, sf::RenderWindow& window, Scene& scene);
-    void gameUpdate(Scene& scene, Overlays& overlays, const sf::Vector2i& screen_center, sf::RenderWindow& window);
-    void updateOverlays(Overlays& overlays, sf::RenderWindow& window, Scene& scene);
-    sf::Shader shader;
-    sf::Font font;
-    sf::Font font_mono;
-    sf::Music menu_music;
-    sf::Music level1_music;
-    sf::Music level2_music;
-    sf::Music credits_music;
+    void updateInput(Scene& scene, Overlays& overlays, const sf::Vector2i& screen_center, sf::RenderWindow& window);
+    void gameUpdate(Scene& scene);
+    void updateOverlays(Overlays& overlays, sf::RenderWindow& window, const SceneSnapshot& snapshot);
+    ShaderCache shader_cache;
+    QualityShaders quality_shaders[num_quality];
+    BakedShaders baked_shaders;
+    AsyncAsset<sf::Font> font;
+    AsyncAsset<sf::Font> font_mono;
+    AsyncAsset<sf::Music> menu_music;
+    AsyncAsset<sf::Music> level1_music;
+    AsyncAsset<sf::Music> level2_music;
+    AsyncAsset<sf::Music> credits_music;
     bool fullscreen;
     sf::ContextSettings settings;
     sf::VideoMode screen_size;
     sf::Uint32 window_style;
-    sf::Clock clock;
-    float smooth_fps;
-    int lag_ms;
+    FrameScheduler scheduler;
+    FrameScheduler::Mode frame_mode = FrameScheduler::VSYNC;
+    float frame_cap = default_refresh_rate;
     float mouse_wheel;
+    sf::Vector2i mouse_delta;
 
 
 };
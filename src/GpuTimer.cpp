@@ -0,0 +1,120 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "GpuTimer.h"
+#include <SFML/OpenGL.hpp>
+#include <SFML/Window.hpp>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+//Missing from the GL 1.1 headers some platforms ship
+static const GLenum gl_time_elapsed = 0x88BF;
+static const GLenum gl_query_counter_bits = 0x8864;
+static const GLenum gl_query_result = 0x8866;
+static const GLenum gl_query_result_available = 0x8867;
+
+//Query entry points, loaded at runtime since SFML only links GL 1.1
+struct QueryFunctions {
+  void (APIENTRY *GenQueries)(GLsizei n, GLuint* ids);
+  void (APIENTRY *BeginQuery)(GLenum target, GLuint id);
+  void (APIENTRY *EndQuery)(GLenum target);
+  void (APIENTRY *GetQueryiv)(GLenum target, GLenum pname, GLint* params);
+  void (APIENTRY *GetQueryObjectuiv)(GLuint id, GLenum pname, GLuint* params);
+};
+static QueryFunctions glq;
+
+template <typename T>
+static bool LoadFunction(T& func, const char* name) {
+  func = reinterpret_cast<T>(sf::Context::getFunction(name));
+  return func != nullptr;
+}
+
+GpuTimer::GpuTimer() :
+  next(0),
+  state(0),
+  active(false) {
+  for (int i = 0; i < num_queries; ++i) {
+    queries[i] = 0;
+    pending[i] = false;
+  }
+}
+
+bool GpuTimer::Init() {
+  if (!LoadFunction(glq.GenQueries, "glGenQueries") ||
+      !LoadFunction(glq.BeginQuery, "glBeginQuery") ||
+      !LoadFunction(glq.EndQuery, "glEndQuery") ||
+      !LoadFunction(glq.GetQueryiv, "glGetQueryiv") ||
+      !LoadFunction(glq.GetQueryObjectuiv, "glGetQueryObjectuiv")) {
+    return false;
+  }
+
+  //Timer queries need GL 3.3 or ARB_timer_query, older drivers have no counter bits for them
+  while (glGetError() != GL_NO_ERROR) {}
+  GLint bits = 0;
+  glq.GetQueryiv(gl_time_elapsed, gl_query_counter_bits, &bits);
+  if (glGetError() != GL_NO_ERROR || bits == 0) {
+    return false;
+  }
+  glq.GenQueries(num_queries, queries);
+  return true;
+}
+
+void GpuTimer::Begin() {
+  if (state == 0) {
+    state = (Init() ? 1 : -1);
+  }
+  active = (state > 0 && !pending[next]);
+  if (active) {
+    glq.BeginQuery(gl_time_elapsed, queries[next]);
+  }
+}
+
+void GpuTimer::End() {
+  if (!active) {
+    return;
+  }
+  glq.EndQuery(gl_time_elapsed);
+  pending[next] = true;
+  next = (next + 1) % num_queries;
+  active = false;
+}
+
+bool GpuTimer::Poll(float& seconds) {
+  if (state <= 0) {
+    return false;
+  }
+
+  //The slot written next is the oldest, results arrive in order
+  for (int i = 0; i < num_queries; ++i) {
+    const int slot = (next + i) % num_queries;
+    if (!pending[slot]) {
+      continue;
+    }
+    GLuint available = 0;
+    glq.GetQueryObjectuiv(queries[slot], gl_query_result_available, &available);
+    if (!available) {
+      return false;
+    }
+    GLuint ns = 0;
+    glq.GetQueryObjectuiv(queries[slot], gl_query_result, &ns);
+    pending[slot] = false;
+    seconds = float(ns) * 1e-9f;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,47 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+//Measures how long the GPU spends on a span of commands with GL_TIME_ELAPSED
+//queries. Results are only read once the GPU has them, a frame or two later,
+//so measuring never makes the CPU wait for the GPU.
+class GpuTimer {
+public:
+  GpuTimer();
+
+  //Both must be called in the context that does the drawing. If every query
+  //is still in flight the span is not measured.
+  void Begin();
+  void End();
+
+  //Takes the oldest finished measurement, false if none is ready yet
+  bool Poll(float& seconds);
+
+  //False once it is known that the context has no timer queries
+  bool IsSupported() const { return state >= 0; }
+
+private:
+  static const int num_queries = 3;
+
+  bool Init();
+
+  unsigned int queries[num_queries];
+  bool         pending[num_queries];
+  int          next;
+  int          state;
+  bool         active;
+};
@@ -0,0 +1,287 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Headless.h"
+#include "CpuRenderer.h"
+#include "Res.h"
+#include "Scene.h"
+#include "ShaderVariant.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+static const int default_frames = 600;
+static const int default_width = 1280;
+static const int default_height = 720;
+static const int default_writers = 2;
+static const int frames_per_writer = 4; //How many frames may wait to be saved, per writer thread
+
+static const char usage[] =
+  "Usage: MarbleMarcher --headless [--path intro|screensaver|level|start] [--level N]\n"
+  "                     [--frames N] [--size WxH] [--out DIR] [--format png|ppm]\n"
+  "                     [--writers N] [--cpu]\n"
+  "  --path     camera path: the menu intro, the screen saver, a level flythrough\n"
+  "             or a still of the level's start, as cpu_render_test's reference\n"
+  "  --level    level for the flythrough or still, 1 to 15\n"
+  "  --cpu      render with the CPU ray marcher, for machines without a GPU\n";
+
+static bool SavePPM(const std::string& fname, int width, int height, const std::vector<sf::Uint8>& rgba) {
+  std::ofstream fout(fname.c_str(), std::ios::binary);
+  if (!fout) {
+    return false;
+  }
+  fout << "P6\n" << width << " " << height << "\n255\n";
+  std::vector<char> row(width * 3);
+  for (int y = 0; y < height; ++y) {
+    const sf::Uint8* src = &rgba[(size_t)y * width * 4];
+    for (int x = 0; x < width; ++x) {
+      row[x*3 + 0] = (char)src[x*4 + 0];
+      row[x*3 + 1] = (char)src[x*4 + 1];
+      row[x*3 + 2] = (char)src[x*4 + 2];
+    }
+    fout.write(row.data(), row.size());
+  }
+  return fout.good();
+}
+
+static bool EndsWith(const std::string& str, const char* suffix) {
+  const size_t n = std::strlen(suffix);
+  return str.size() >= n && str.compare(str.size() - n, n, suffix) == 0;
+}
+
+FrameWriter::FrameWriter(int num_threads, int max_queued) :
+  max_queued(std::max(max_queued, 1)),
+  num_busy(0),
+  num_failed(0),
+  seconds_blocked(0.0),
+  quit(false) {
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    workers.emplace_back(&FrameWriter::WorkerLoop, this);
+  }
+}
+
+FrameWriter::~FrameWriter() {
+  Finish();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  cond_pop.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
+void FrameWriter::Push(const std::string& fname, int width, int height, std::vector<sf::Uint8>& rgba) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if ((int)queue.size() >= max_queued) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cond_push.wait(lock, [this] { return (int)queue.size() < max_queued; });
+    seconds_blocked += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  queue.push_back(Frame());
+  Frame& frame = queue.back();
+  frame.fname = fname;
+  frame.width = width;
+  frame.height = height;
+  frame.rgba.swap(rgba);
+  rgba.clear();
+  lock.unlock();
+  cond_pop.notify_one();
+}
+
+void FrameWriter::Finish() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cond_push.wait(lock, [this] { return queue.empty() && num_busy == 0; });
+}
+
+void FrameWriter::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cond_pop.wait(lock, [this] { return quit || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    Frame frame;
+    frame.fname.swap(queue.front().fname);
+    frame.width = queue.front().width;
+    frame.height = queue.front().height;
+    frame.rgba.swap(queue.front().rgba);
+    queue.pop_front();
+    num_busy += 1;
+    lock.unlock();
+    cond_push.notify_all();
+
+    //Encode and write without holding the lock
+    bool ok;
+    if (EndsWith(frame.fname, ".ppm")) {
+      ok = SavePPM(frame.fname, frame.width, frame.height, frame.rgba);
+    } else {
+      sf::Image img;
+      img.create(frame.width, frame.height, frame.rgba.data());
+      ok = img.saveToFile(frame.fname);
+    }
+
+    lock.lock();
+    num_busy -= 1;
+    if (!ok) {
+      num_failed += 1;
+      std::cerr << "Failed to write " << frame.fname << std::endl;
+    }
+    cond_push.notify_all();
+  }
+}
+
+static bool MakeDir(const std::string& path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) == 0) {
+    return (info.st_mode & S_IFDIR) != 0;
+  }
+#if defined(_WIN32)
+  return CreateDirectory(path.c_str(), NULL) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+  return mkdir(path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == 0;
+#endif
+}
+
+int RunHeadless(int argc, char* argv[]) {
+  //Parse the options
+  std::string path = "intro";
+  std::string out_dir = "frames";
+  std::string format = "png";
+  int level = 1;
+  int num_frames = default_frames;
+  int width = default_width;
+  int height = default_height;
+  int num_writers = default_writers;
+  bool use_cpu = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = (i + 1 < argc);
+    if (arg == "--headless") {
+      continue;
+    } else if (arg == "--path" && has_value) {
+      path = argv[++i];
+    } else if (arg == "--level" && has_value) {
+      level = std::atoi(argv[++i]);
+    } else if (arg == "--frames" && has_value) {
+      num_frames = std::atoi(argv[++i]);
+    } else if (arg == "--size" && has_value) {
+      if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2) { width = 0; }
+    } else if (arg == "--out" && has_value) {
+      out_dir = argv[++i];
+    } else if (arg == "--format" && has_value) {
+      format = argv[++i];
+    } else if (arg == "--writers" && has_value) {
+      num_writers = std::atoi(argv[++i]);
+    } else if (arg == "--cpu") {
+      use_cpu = true;
+    } else {
+      std::cerr << usage;
+      return 1;
+    }
+  }
+  if ((path != "intro" && path != "screensaver" && path != "level" && path != "start") ||
+      (format != "png" && format != "ppm") || level < 1 || level > num_levels ||
+      num_frames < 1 || width < 1 || height < 1 || num_writers < 1) {
+    std::cerr << usage;
+    return 1;
+  }
+  if (!MakeDir(out_dir)) {
+    std::cerr << "Failed to create output directory " << out_dir << std::endl;
+    return 1;
+  }
+
+  //The GPU path draws the shader into an offscreen texture, no window needed
+  sf::Shader shader;
+  sf::RenderTexture target;
+  CpuRenderer cpu_renderer;
+  if (!use_cpu) {
+    if (!sf::Shader::isAvailable()) {
+      std::cerr << "Graphics card does not support shaders, try --cpu" << std::endl;
+      return 1;
+    }
+    if (!LoadShaderRes(shader, vert_glsl, sf::Shader::Vertex) ||
+        !LoadShaderRes(shader, frag_glsl, sf::Shader::Fragment)) {
+      std::cerr << "Failed to compile shaders" << std::endl;
+      return 1;
+    }
+    if (!target.create(width, height)) {
+      std::cerr << "Failed to create render texture" << std::endl;
+      return 1;
+    }
+    shader.setUniform("iResolution", sf::Glsl::Vec2((float)width, (float)height));
+  }
+
+  //Without music the scene has no audio at all, so no sound device is needed
+  Scene scene;
+  if (path == "screensaver") {
+    scene.SetMode(Scene::SCREEN_SAVER);
+  } else if (path == "level") {
+    scene.StartSingle(level - 1);
+  }
+
+  //Render one physics tick per frame so every run gives the same frames
+  FrameWriter writer(num_writers, num_writers * frames_per_writer);
+  std::vector<sf::Uint8> rgba;
+  sf::RectangleShape rect(sf::Vector2f((float)width, (float)height));
+  sf::RenderStates states = sf::RenderStates::Default;
+  states.shader = &shader;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < num_frames; ++frame) {
+    SceneUniforms u;
+    if (path == "start") {
+      u = SceneUniforms::LevelStart(all_levels[level - 1]);
+    } else {
+      if (path == "level") {
+        scene.UpdateMarble();
+      }
+      scene.UpdateCamera();
+      scene.GetUniforms(u);
+    }
+
+    if (use_cpu) {
+      cpu_renderer.Render(u, width, height, rgba);
+    } else {
+      Scene::Write(shader, u);
+      target.draw(rect, states);
+      target.display();
+      const sf::Image img = target.getTexture().copyToImage();
+      rgba.assign(img.getPixelsPtr(), img.getPixelsPtr() + (size_t)width * height * 4);
+    }
+
+    char fname[32];
+    std::snprintf(fname, sizeof(fname), "/frame_%05d.%s", frame, format.c_str());
+    writer.Push(out_dir + fname, width, height, rgba);
+  }
+  const double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  writer.Finish();
+  const double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << num_frames << " frames at " << width << "x" << height << " in " << total_seconds << "s ("
+            << (num_frames / render_seconds) << " fps rendering, " << writer.GetSecondsBlocked()
+            << "s waiting on the writers)" << std::endl;
+  return writer.GetNumFailed() > 0 ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Encodes and saves frames on worker threads so the renderer doesn't wait on the
+//disk. At most max_queued frames can be waiting, Push blocks beyond that so a
+//slow disk can't use up all the memory.
+class FrameWriter {
+public:
+  FrameWriter(int num_threads, int max_queued);
+  ~FrameWriter();
+
+  //Queue RGBA pixels (top row first) to be saved as PNG or PPM depending on the
+  //file extension. Takes the contents of rgba, leaving it empty.
+  void Push(const std::string& fname, int width, int height, std::vector<sf::Uint8>& rgba);
+
+  //Wait until every queued frame is saved
+  void Finish();
+
+  int GetNumFailed() const { return num_failed; }
+  double GetSecondsBlocked() const { return seconds_blocked; }
+
+protected:
+  void WorkerLoop();
+
+private:
+  struct Frame {
+    std::string fname;
+    int width;
+    int height;
+    std::vector<sf::Uint8> rgba;
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<Frame>        queue;
+  std::mutex               mutex;
+  std::condition_variable  cond_push;
+  std::condition_variable  cond_pop;
+  int                      max_queued;
+  int                      num_busy;
+  int                      num_failed;
+  double                   seconds_blocked;
+  bool                     quit;
+};
+
+//Renders a scripted camera path offscreen and saves every frame to disk, without
+//a window or resolution menu. Called from main when --headless is given.
+int RunHeadless(int argc, char* argv[]);
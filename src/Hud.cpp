@@ -0,0 +1,81 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Hud.h"
+#include "AssetLoader.h"
+#include "Res.h"
+#include <SFML/OpenGL.hpp>
+#include <iostream>
+
+//Every font and size the HUD draws with
+struct HudSize {
+  float size;
+  bool mono;
+};
+static const HudSize hud_sizes[] = {
+  { hud_countdown_size, false },
+  { hud_timer_size, true },
+  { hud_desc_size, false },
+  { hud_fps_size, false },
+};
+
+Hud::Hud() : ready(false), scale(0.0f) {
+}
+
+Hud::~Hud() {
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void Hud::Prewarm(float draw_scale) {
+  if (worker.joinable()) {
+    if (draw_scale == scale) { return; }
+    worker.join();
+  }
+  ready = false;
+  scale = draw_scale;
+  worker = std::thread(&Hud::Run, this, draw_scale);
+}
+
+void Hud::Draw(sf::RenderTarget& target) {
+  batch.Draw(target);
+  batch.Clear();
+}
+
+void Hud::Run(float draw_scale) {
+  //Glyph pages are textures, so this thread needs a context of its own
+  sf::Context context;
+  if (!LoadAsset(font, Orbitron_Bold_ttf) || !LoadAsset(font_mono, Inconsolata_Bold_ttf)) {
+    std::cerr << "Unable to load HUD fonts" << std::endl;
+    return;
+  }
+
+  //Same sizes and outline Overlays::MakeText asks for, so the glyphs are hits
+  const float outline = text_outline * draw_scale;
+  for (size_t i = 0; i < sizeof(hud_sizes) / sizeof(hud_sizes[0]); ++i) {
+    const sf::Font& f = GetFont(hud_sizes[i].mono);
+    const unsigned int size = (unsigned int)int(hud_sizes[i].size * draw_scale);
+    for (sf::Uint32 c = ' '; c <= '~'; ++c) {
+      f.getGlyph(c, size, false);
+      f.getGlyph(c, size, false, outline);
+    }
+  }
+
+  //Make sure the uploads are complete before the window's context uses them
+  glFinish();
+  ready = true;
+}
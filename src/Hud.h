@@ -0,0 +1,63 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "TextBatch.h"
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <thread>
+
+static const float text_outline = 3.0f;         //Outline thickness of all overlay text
+static const float hud_countdown_size = 140.0f; //Character sizes of the in-game text, relative to 1280x720
+static const float hud_timer_size = 60.0f;
+static const float hud_desc_size = 48.0f;
+static const float hud_fps_size = 24.0f;
+
+//Draws the in-game text and arrow with one batched draw per texture. SFML
+//rasterizes and uploads glyphs the first time a character is shown at a
+//size, which hitches the frame the countdown starts. The HUD keeps its own
+//copies of the fonts so every glyph it can show is rasterized ahead of time
+//on a background thread while the menus use the other copies.
+class Hud {
+public:
+  Hud();
+  ~Hud();
+
+  //Loads the fonts and starts rasterizing all of their HUD sizes at this
+  //scale, unless that was already started
+  void Prewarm(float draw_scale);
+
+  //The fonts may only be used once the background thread is done with them
+  bool IsReady() const { return ready; }
+  const sf::Font& GetFont(bool mono) const { return mono ? font_mono : font; }
+
+  void Add(const sf::Text& text) { batch.Add(text); }
+  void Add(const sf::Sprite& sprite) { batch.Add(sprite); }
+
+  //Draws everything added since the last call
+  void Draw(sf::RenderTarget& target);
+
+protected:
+  void Run(float draw_scale);
+
+private:
+  sf::Font          font;
+  sf::Font          font_mono;
+  TextBatch         batch;
+  std::thread       worker;
+  std::atomic<bool> ready;
+  float             scale;
+};
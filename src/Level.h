@@ -36,6 +36,8 @@ public:
         const char* desc,
         float an1=0.0f, float an2=0.0f, float an3=0.0f);
 
+  bool IsAnimated() const { return anim_1 != 0.0f || anim_2 != 0.0f || anim_3 != 0.0f; }
+
   FractalParams params;      //Fractal parameters
   float marble_rad;          //Radius of the marble
   float start_look_x;        //Camera direction on start
@@ -15,16 +15,26 @@
 * along with this program.If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Scene.h"
+#include "AssetLoader.h"
+#include "BakedShaders.h"
+#include "DynamicRes.h"
+#include "FrameScheduler.h"
+#include "GL3Backend.h"
+#include "Headless.h"
 #include "Level.h"
 #include "Overlays.h"
+#include "Quality.h"
 #include "Res.h"
 #include "SelectRes.h"
+#include "SimThread.h"
 #include "Scores.h"
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include <SFML/OpenGL.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -42,6 +52,8 @@
 static const float mouse_sensitivity = 0.005f;
 static const float wheel_sensitivity = 0.2f;
 static const float music_vol = 75.0f;
+static const float tick_rate = 60.0f;      //Fixed simulation rate all game constants are tuned for
+static const float max_frame_time = 0.25f; //Drop time beyond this instead of simulating it
 
 //Game modes
 enum GameMode {
@@ -94,49 +106,43 @@ int WinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR lpCmdLine, int nCmdShow) {
 #else
 int main(int argc, char *argv[]) {
 #endif
+  //Render frames to disk without a window if requested
+#if defined(_WIN32)
+  const int argc = __argc;
+  char** argv = __argv;
+#endif
+  //Map the asset pack next to the executable, the headless renderer uses it too
+  OpenResPack(argv[0]);
+
+  bool use_gl3 = false;
+  FrameScheduler::Mode frame_mode = FrameScheduler::VSYNC;
+  float frame_cap = default_refresh_rate;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--headless") == 0) {
+      return RunHeadless(argc, argv);
+    } else if (std::strcmp(argv[i], "--gl3") == 0) {
+      use_gl3 = true;
+    } else if (std::strcmp(argv[i], "--uncapped") == 0) {
+      frame_mode = FrameScheduler::UNCAPPED;
+    } else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      frame_mode = FrameScheduler::FIXED;
+      frame_cap = (float)std::atof(argv[++i]);
+    }
+  }
+
   //Make sure shader is supported
   if (!sf::Shader::isAvailable()) {
     ERROR_MSG("Graphics card does not support shaders");
     return 1;
   }
-  //Load the vertex shader
-  sf::Shader shader;
-  if (!shader.loadFromFile(vert_glsl, sf::Shader::Vertex)) {
-    ERROR_MSG("Failed to compile vertex shader");
-    return 1;
-  }
-  //Load the fragment shader
-  if (!shader.loadFromFile(frag_glsl, sf::Shader::Fragment)) {
-    ERROR_MSG("Failed to compile fragment shader");
-    return 1;
-  }
-
-  //Load the font
-  sf::Font font;
-  if (!font.loadFromFile(Orbitron_Bold_ttf)) {
-    ERROR_MSG("Unable to load font");
-    return 1;
-  }
-  //Load the mono font
-  sf::Font font_mono;
-  if (!font_mono.loadFromFile(Inconsolata_Bold_ttf)) {
-    ERROR_MSG("Unable to load mono font");
-    return 1;
-  }
-
-  //Load the music
-  sf::Music menu_music;
-  menu_music.openFromFile(menu_ogg);
-  menu_music.setLoop(true);
-  sf::Music level1_music;
-  level1_music.openFromFile(level1_ogg);
-  level1_music.setLoop(true);
-  sf::Music level2_music;
-  level2_music.openFromFile(level2_ogg);
-  level2_music.setLoop(true);
-  sf::Music credits_music;
-  credits_music.openFromFile(credits_ogg);
-  credits_music.setLoop(true);
+  //Start loading the fonts and music in the background, sounds and images
+  //start loading as the objects that play and draw them are created
+  AsyncAsset<sf::Font> font_asset(Orbitron_Bold_ttf);
+  AsyncAsset<sf::Font> font_mono_asset(Inconsolata_Bold_ttf);
+  AsyncAsset<sf::Music> menu_music_asset(menu_ogg);
+  AsyncAsset<sf::Music> level1_music_asset(level1_ogg);
+  AsyncAsset<sf::Music> level2_music_asset(level2_ogg);
+  AsyncAsset<sf::Music> credits_music_asset(credits_ogg);
 
   //Get the directory for saving and loading high scores
 #ifdef _WIN32
@@ -157,10 +163,21 @@ int main(int argc, char *argv[]) {
     }
   }
   const std::string save_file = save_dir + "/scores.bin";
+  const std::string quality_file = save_dir + "/quality.bin";
 
   //Load scores if available
   high_scores.Load(save_file);
 
+  //Load the render quality
+  LoadQuality(quality_file);
+
+  //The resolution picker only needs the mono font
+  if (!font_mono_asset.Wait()) {
+    ERROR_MSG("Unable to load mono font");
+    return 1;
+  }
+  sf::Font& font_mono = font_mono_asset.Get();
+
   //Have user select the resolution
   SelectRes select_res(&font_mono);
   const Resolution* resolution = select_res.Run();
@@ -169,10 +186,10 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  //GL settings
+  //GL settings, the GL 3.3 backend still needs the compatibility profile
   sf::ContextSettings settings;
-  settings.majorVersion = 2;
-  settings.minorVersion = 0;
+  settings.majorVersion = (use_gl3 ? 3 : 2);
+  settings.minorVersion = (use_gl3 ? 3 : 0);
 
   //Create the window
   sf::VideoMode screen_size;
@@ -186,29 +203,58 @@ int main(int argc, char *argv[]) {
     window_style = sf::Style::Close;
   }
   sf::RenderWindow window(screen_size, "Marble Marcher", window_style, settings);
-  window.setVerticalSyncEnabled(true);
+  FrameScheduler scheduler;
+  scheduler.SetMode(window, frame_mode, frame_cap);
   window.setKeyRepeatEnabled(false);
   window.requestFocus();
 
-  //If native resolution is the same, then we don't need a render texture
-  if (resolution->width == screen_size.width && resolution->height == screen_size.height) {
-    fullscreen = false;
+  //Render at up to the selected resolution, scaled down when frames take too long
+  DynamicRes dyn_res;
+  if (!dyn_res.Create(resolution->width, resolution->height, settings)) {
+    ERROR_MSG("Failed to create render texture");
+    return 1;
   }
 
-  //Create the render texture if needed
-  sf::RenderTexture renderTexture;
-  if (fullscreen) {
-    renderTexture.create(resolution->width, resolution->height, settings);
-    renderTexture.setSmooth(true);
-    renderTexture.setActive(true);
-    window.setActive(false);
+  //Use the GL 3.3 backend if asked for and the driver has it
+  GL3Backend gl3;
+  if (use_gl3 && gl3.Create(window)) {
+    dyn_res.SetBackend(&gl3);
   }
 
+  //Compile the fractal shader for every preset in the window's context
+  window.setActive(true);
+  ShaderCache shader_cache;
+  QualityShaders quality_shaders[num_quality];
+  if (!CompileQualityShaders(shader_cache, quality_shaders)) {
+    ERROR_MSG("Failed to compile fractal shader");
+    return 1;
+  }
+
+  //Level specific shaders, compiled in the background as levels come up
+  BakedShaders baked_shaders;
+  window.setActive(false);
+
+  //Everything else has had the resolution picker and shader compile to load
+  if (!font_asset.Wait()) {
+    ERROR_MSG("Unable to load font");
+    return 1;
+  }
+  sf::Font& font = font_asset.Get();
+  menu_music_asset.Wait();
+  level1_music_asset.Wait();
+  level2_music_asset.Wait();
+  credits_music_asset.Wait();
+  sf::Music& menu_music = menu_music_asset.Get();
+  menu_music.setLoop(true);
+  sf::Music& level1_music = level1_music_asset.Get();
+  level1_music.setLoop(true);
+  sf::Music& level2_music = level2_music_asset.Get();
+  level2_music.setLoop(true);
+  sf::Music& credits_music = credits_music_asset.Get();
+  credits_music.setLoop(true);
+
   //Create the fractal scene
   Scene scene(&level1_music, &level2_music);
-  const sf::Glsl::Vec2 window_res((float)resolution->width, (float)resolution->height);
-  shader.setUniform("iResolution", window_res);
-  scene.Write(shader);
 
   //Create the menus
   Overlays overlays(&font, &font_mono);
@@ -216,13 +262,47 @@ int main(int argc, char *argv[]) {
   menu_music.setVolume(GetVol());
   menu_music.play();
 
+  //Physics and game state run on their own thread in fixed ticks, input is
+  //gathered here and handed over while holding the simulation's lock
+  sf::Vector2i mouse_delta(0, 0);
+  float mouse_wheel = 0.0f;
+  SimThread sim(scene, tick_rate, max_frame_time, [&]() {
+    if (game_mode == MAIN_MENU || game_mode == CONTROLS || game_mode == LEVELS || game_mode == SCREEN_SAVER) {
+      scene.UpdateCamera();
+    } else if (game_mode == PLAYING || game_mode == CREDITS) {
+      //Collect keyboard input
+      const float force_lr =
+        (all_keys[sf::Keyboard::Left] || all_keys[sf::Keyboard::A] ? -1.0f : 0.0f) +
+        (all_keys[sf::Keyboard::Right] || all_keys[sf::Keyboard::D] ? 1.0f : 0.0f);
+      const float force_ud =
+        (all_keys[sf::Keyboard::Down] || all_keys[sf::Keyboard::S] ? -1.0f : 0.0f) +
+        (all_keys[sf::Keyboard::Up] || all_keys[sf::Keyboard::W] ? 1.0f : 0.0f);
+
+      //Collect mouse input
+      float ms = mouse_sensitivity;
+      if (mouse_setting == 1) {
+        ms *= 0.5f;
+      } else if (mouse_setting == 2) {
+        ms *= 0.25f;
+      }
+      const float cam_lr = float(-mouse_delta.x) * ms;
+      const float cam_ud = float(-mouse_delta.y) * ms;
+      const float cam_z = mouse_wheel * wheel_sensitivity;
+      mouse_delta = sf::Vector2i(0, 0);
+
+      //Apply forces to marble and camera
+      scene.UpdateMarble(force_lr, force_ud);
+      scene.UpdateCamera(cam_lr, cam_ud, cam_z);
+    }
+    mouse_wheel = 0.0f;
+  });
+  sim.Start();
+
   //Main loop
-  sf::Clock clock;
-  float smooth_fps = 60.0f;
-  int lag_ms = 0;
   while (window.isOpen()) {
+    //Events change the game state the ticks read
+    std::unique_lock<std::mutex> sim_lock(sim.GetMutex());
     sf::Event event;
-    float mouse_wheel = 0.0f;
     while (window.pollEvent(event)) {
       if (event.type == sf::Event::Closed) {
         window.close();
@@ -318,7 +398,7 @@ int main(int argc, char *argv[]) {
             scene.SetMode(Scene::INTRO);
             game_mode = MAIN_MENU;
           } else if (game_mode == PAUSED) {
-            const Overlays::Texts selected = overlays.GetOption(Overlays::CONTINUE, Overlays::MOUSE);
+            const Overlays::Texts selected = overlays.GetOption(Overlays::CONTINUE, Overlays::QUALITY);
             if (selected == Overlays::CONTINUE) {
               game_mode = PLAYING;
               scene.GetCurMusic().setVolume(GetVol());
@@ -347,6 +427,8 @@ int main(int argc, char *argv[]) {
               level2_music.setVolume(GetVol());
             } else if (selected == Overlays::MOUSE) {
               mouse_setting = (mouse_setting + 1) % 3;
+            } else if (selected == Overlays::QUALITY) {
+              NextQuality(quality_shaders);
             }
           }
         } else if (event.mouseButton.button == sf::Mouse::Right) {
@@ -371,79 +453,37 @@ int main(int argc, char *argv[]) {
       credits_music.play();
     }
 
-    //Main game update
+    //Menus follow the mouse, the camera gets however far it moved by the next tick
     if (game_mode == MAIN_MENU) {
-      scene.UpdateCamera();
       overlays.UpdateMenu((float)mouse_pos.x, (float)mouse_pos.y);
     } else if (game_mode == CONTROLS) {
-      scene.UpdateCamera();
       overlays.UpdateControls((float)mouse_pos.x, (float)mouse_pos.y);
     } else if (game_mode == LEVELS) {
-      scene.UpdateCamera();
       overlays.UpdateLevels((float)mouse_pos.x, (float)mouse_pos.y);
-    } else if (game_mode == SCREEN_SAVER) {
-      scene.UpdateCamera();
     } else if (game_mode == PLAYING || game_mode == CREDITS) {
-      //Collect keyboard input
-      const float force_lr =
-        (all_keys[sf::Keyboard::Left] || all_keys[sf::Keyboard::A] ? -1.0f : 0.0f) +
-        (all_keys[sf::Keyboard::Right] || all_keys[sf::Keyboard::D] ? 1.0f : 0.0f);
-      const float force_ud =
-        (all_keys[sf::Keyboard::Down] || all_keys[sf::Keyboard::S] ? -1.0f : 0.0f) +
-        (all_keys[sf::Keyboard::Up] || all_keys[sf::Keyboard::W] ? 1.0f : 0.0f);
-
-      //Collect mouse input
-      const sf::Vector2i mouse_delta = mouse_pos - screen_center;
+      mouse_delta += mouse_pos - screen_center;
       sf::Mouse::setPosition(screen_center, window);
-      float ms = mouse_sensitivity;
-      if (mouse_setting == 1) {
-        ms *= 0.5f;
-      } else if (mouse_setting == 2) {
-        ms *= 0.25f;
-      }
-      const float cam_lr = float(-mouse_delta.x) * ms;
-      const float cam_ud = float(-mouse_delta.y) * ms;
-      const float cam_z = mouse_wheel * wheel_sensitivity;
-
-      //Apply forces to marble and camera
-      scene.UpdateMarble(force_lr, force_ud);
-      scene.UpdateCamera(cam_lr, cam_ud, cam_z);
+      mouse_pos = screen_center;
     } else if (game_mode == PAUSED) {
       overlays.UpdatePaused((float)mouse_pos.x, (float)mouse_pos.y);
     }
-
-    bool skip_frame = false;
-    if (lag_ms >= 16) {
-      //If there is too much lag, just do another frame of physics and skip the draw
-      lag_ms -= 16;
-      skip_frame = true;
-    } else {
-      //Update the shader values
-      scene.Write(shader);
-
-      //Setup full-screen shader
-      sf::RenderStates states = sf::RenderStates::Default;
-      states.shader = &shader;
-      sf::RectangleShape rect;
-      rect.setSize(window_res);
-      rect.setPosition(0, 0);
-
-      //Draw the fractal
-      if (fullscreen) {
-        //Draw to the render texture
-        renderTexture.draw(rect, states);
-        renderTexture.display();
-
-        //Draw render texture to main window
-        sf::Sprite sprite(renderTexture.getTexture());
-        sprite.setScale(float(screen_size.width) / float(resolution->width),
-                        float(screen_size.height) / float(resolution->height));
-        window.draw(sprite);
-      } else {
-        //Draw directly to the main window
-        window.draw(rect, states);
-      }
-    }
+    sim_lock.unlock();
+
+    //Blend the newest snapshot between its last two ticks and pick the shaders
+    //of the current quality preset, using the level's baked shaders once they
+    //are compiled
+    sim.Update();
+    const SceneSnapshot& snapshot = sim.GetSnapshot();
+    SceneUniforms frame;
+    snapshot.GetFrameUniforms(frame, sim.GetAlpha());
+    QualityShaders quality = quality_shaders[quality_setting];
+    baked_shaders.Get(snapshot.level, quality_setting, frame.frac_params, quality);
+    sf::Shader& shader = *quality.main;
+    dyn_res.SetPasses(quality.cone, quality.shadow, quality.baked);
+
+    //Draw the fractal, in whatever time the display leaves for it
+    dyn_res.SetFrameTime(scheduler.GetFrameTime());
+    dyn_res.Draw(shader, window, frame);
 
     //Draw text overlays to the window
     if (game_mode == MAIN_MENU) {
@@ -453,37 +493,24 @@ int main(int argc, char *argv[]) {
     } else if (game_mode == LEVELS) {
       overlays.DrawLevels(window);
     } else if (game_mode == PLAYING) {
-      if (scene.GetMode() == Scene::ORBIT && scene.GetMarble().x() < 998.0f) {
-        overlays.DrawLevelDesc(window, scene.GetLevel());
-      } else if (scene.GetMode() == Scene::MARBLE) {
-        overlays.DrawArrow(window, scene.GetGoalDirection());
+      if (snapshot.cam_mode == Scene::ORBIT && snapshot.marble_pos.x() < 998.0f) {
+        overlays.DrawLevelDesc(snapshot.level);
+      } else if (snapshot.cam_mode == Scene::MARBLE) {
+        overlays.DrawArrow(snapshot.goal_direction);
       }
-      overlays.DrawTimer(window, scene.GetCountdownTime(), scene.IsHighScore());
+      overlays.DrawTimer(snapshot.countdown_time, snapshot.high_score);
     } else if (game_mode == PAUSED) {
       overlays.DrawPaused(window);
     } else if (game_mode == CREDITS) {
       overlays.DrawCredits(window);
     }
-    overlays.DrawFPS(window, int(smooth_fps + 0.5f));
-
-    if (!skip_frame) {
-      //Finally display to the screen
-      window.display();
+    overlays.DrawFPS(int(scheduler.GetStats().fps + 0.5f));
+    overlays.DrawHud(window);
 
-      //If V-Sync is running higher than desired fps, slow down!
-      const float s = clock.restart().asSeconds();
-      if (s > 0.0f) {
-        smooth_fps = smooth_fps*0.9f + std::min(1.0f / s, 60.0f)*0.1f;
-      }
-      const int time_diff_ms = int(16.66667f - s*1000.0f);
-      if (time_diff_ms > 0) {
-        sf::sleep(sf::milliseconds(time_diff_ms));
-        lag_ms = std::max(lag_ms - time_diff_ms, 0);
-      } else if (time_diff_ms < 0) {
-        lag_ms += std::max(-time_diff_ms, 0);
-      }
-    }
+    //Finally display to the screen when the frame is due
+    scheduler.Present(window);
   }
+  sim.Stop();
 
   //Stop all music
   menu_music.stop();
@@ -491,6 +518,7 @@ int main(int argc, char *argv[]) {
   level2_music.stop();
   credits_music.stop();
   high_scores.Save(save_file);
+  SaveQuality(quality_file);
 
 #ifdef _DEBUG
   system("pause");
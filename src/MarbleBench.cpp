@@ -0,0 +1,316 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Level.h"
+#include "CpuRenderer.h"
+#include "FractalKernel.h"
+#include "FractalBatch.h"
+#include "MarbleSim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Microbenchmarks of the physics hot paths and the CPU renderer on every level. Prints JSON to stdout, and
+//with --baseline compares the medians to an earlier run and fails on regressions.
+//
+//  marble_bench [--ticks N] [--out file.json] [--baseline file.json] [--tolerance 0.15]
+
+static const int num_points = 4096;     //Points near the surface per level
+static const int batch_size = 64;       //Calls timed together for one sample
+static const int default_ticks = 2400;  //Scripted physics ticks per level
+static const float near_surface = 4.0f; //Max distance of sample points, in marble radii
+static const float default_tolerance = 0.15f;
+static const int render_width = 160;    //CPU rendered frames per level, ns per ray is the metric
+static const int render_height = 90;
+static const int render_frames = 3;
+
+typedef MarbleSim::Kernel Kernel;
+typedef std::chrono::steady_clock Clock;
+
+//Keeps the optimizer from throwing away results that are never used
+static volatile float sink;
+
+struct Stats {
+  double p50, p90, p99, mean;
+};
+
+static Stats Summarize(std::vector<double>& samples) {
+  std::sort(samples.begin(), samples.end());
+  Stats s;
+  const size_t n = samples.size();
+  s.p50 = samples[n * 50 / 100];
+  s.p90 = samples[n * 90 / 100];
+  s.p99 = samples[std::min(n - 1, n * 99 / 100)];
+  s.mean = 0.0;
+  for (size_t i = 0; i < n; ++i) { s.mean += samples[i]; }
+  s.mean /= n;
+  return s;
+}
+
+static double ElapsedNs(const Clock::time_point& start) {
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+//Fixed, seeded points within a few marble radii of the fractal around the level start
+static std::vector<Eigen::Vector3f> SurfacePoints(const Kernel& kernel, const Level& level, int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+  std::vector<Eigen::Vector3f> pts;
+  for (int tries = 0; tries < num_points * 1000 && (int)pts.size() < num_points; ++tries) {
+    const Eigen::Vector3f p = level.start_pos + Eigen::Vector3f(u(rng), u(rng), u(rng)) * (60.0f * level.marble_rad);
+    if (kernel.DE(p) < near_surface * level.marble_rad) {
+      pts.push_back(p);
+    }
+  }
+  return pts;
+}
+
+static Stats BenchDE(const Kernel& kernel, const std::vector<Eigen::Vector3f>& pts) {
+  std::vector<double> samples;
+  for (size_t i = 0; i + batch_size <= pts.size(); i += batch_size) {
+    float acc = 0.0f;
+    const Clock::time_point start = Clock::now();
+    for (int j = 0; j < batch_size; ++j) {
+      acc += kernel.DE(pts[i + j]);
+    }
+    samples.push_back(ElapsedNs(start) / batch_size);
+    sink = acc;
+  }
+  return Summarize(samples);
+}
+
+static Stats BenchNP(const Kernel& kernel, const std::vector<Eigen::Vector3f>& pts) {
+  std::vector<double> samples;
+  Kernel::Folded folded;
+  for (size_t i = 0; i + batch_size <= pts.size(); i += batch_size) {
+    float acc = 0.0f;
+    const Clock::time_point start = Clock::now();
+    for (int j = 0; j < batch_size; ++j) {
+      kernel.Fold(pts[i + j], folded);
+      acc += kernel.NP(folded).x();
+    }
+    samples.push_back(ElapsedNs(start) / batch_size);
+    sink = acc;
+  }
+  return Summarize(samples);
+}
+
+static Stats BenchCollision(const Kernel& kernel, const Level& level, const std::vector<Eigen::Vector3f>& pts) {
+  std::vector<double> samples;
+  for (size_t i = 0; i + batch_size <= pts.size(); i += batch_size) {
+    float acc = 0.0f;
+    const Clock::time_point start = Clock::now();
+    for (int j = 0; j < batch_size; ++j) {
+      acc += MarbleSim::CollisionQuery(kernel, level.marble_rad, pts[i + j]).de;
+    }
+    samples.push_back(ElapsedNs(start) / batch_size);
+    sink = acc;
+  }
+  return Summarize(samples);
+}
+
+static Stats BenchDEBatch(const Level& level, const std::vector<Eigen::Vector3f>& pts) {
+  std::vector<float> xs(pts.size()), ys(pts.size()), zs(pts.size()), out(pts.size());
+  for (size_t i = 0; i < pts.size(); ++i) {
+    xs[i] = pts[i].x(); ys[i] = pts[i].y(); zs[i] = pts[i].z();
+  }
+  std::vector<double> samples;
+  for (size_t i = 0; i + batch_size <= pts.size(); i += batch_size) {
+    const Clock::time_point start = Clock::now();
+    FractalDEBatch(level.params, fractal_iters, &xs[i], &ys[i], &zs[i], &out[i], batch_size);
+    samples.push_back(ElapsedNs(start) / batch_size);
+    sink = out[i];
+  }
+  return Summarize(samples);
+}
+
+//Full physics ticks driven by a scripted input that zig-zags away from the start,
+//restarting the level whenever the marble finishes or falls off
+static Stats BenchTick(Kernel& kernel, const Level& level, MarbleSim::PhysMode mode, int ticks) {
+  std::vector<double> samples;
+  MarbleState m;
+  m.pos = level.start_pos;
+  m.rad = level.marble_rad;
+  FractalParams params = level.params;
+  kernel.Build(params);
+  const float cs = std::cos(level.start_look_x);
+  const float sn = std::sin(level.start_look_x);
+  int timer = 0;
+  for (int i = 0; i < ticks; ++i) {
+    const float dx = ((i / 200) % 2 ? 0.5f : -0.5f) / std::sqrt(1.25f);
+    const float dy = 1.0f / std::sqrt(1.25f);
+    const Eigen::Vector3f push(dx*cs - dy*sn, 0.0f, -dy*cs - dx*sn);
+    const Clock::time_point start = Clock::now();
+    MarbleSim::Tick(kernel, level, mode, m, push);
+    MarbleSim::Animate(level, timer, params);
+    kernel.Build(params);
+    samples.push_back(ElapsedNs(start));
+    timer += 1;
+    if (MarbleSim::HitFlag(level, level.end_pos, m) || m.pos.y() < level.kill_y) {
+      m = MarbleState();
+      m.pos = level.start_pos;
+      m.rad = level.marble_rad;
+      params = level.params;
+      kernel.Build(params);
+      timer = 0;
+    }
+  }
+  return Summarize(samples);
+}
+
+//The view from behind the marble at the start of the level, like Scene in marble mode
+static void StartView(const Level& level, SceneUniforms& u) {
+  const Eigen::Matrix3f rot = (Eigen::AngleAxisf(level.start_look_x, Eigen::Vector3f::UnitY()) *
+                               Eigen::AngleAxisf(-0.3f, Eigen::Vector3f::UnitX())).toRotationMatrix();
+  u.cam_mat.setIdentity();
+  u.cam_mat.block<3, 3>(0, 0) = rot;
+  u.cam_mat.block<3, 1>(0, 3) = level.start_pos + rot * Eigen::Vector3f(0.0f, 0.0f, level.marble_rad * 15.0f) +
+                                Eigen::Vector3f(0.0f, level.marble_rad * 1.5f, 0.0f);
+  u.marble_pos = level.start_pos;
+  u.marble_rad = level.marble_rad;
+  u.flag_pos = level.end_pos;
+  u.flag_scale = level.planet ? -level.marble_rad : level.marble_rad;
+  u.frac_params = level.params;
+  u.exposure = 1.0f;
+}
+
+static Stats BenchRender(const Level& level) {
+  SceneUniforms u;
+  StartView(level, u);
+  CpuRenderer renderer;
+  std::vector<unsigned char> rgba;
+  std::vector<double> samples;
+  for (int i = 0; i < render_frames; ++i) {
+    renderer.Render(u, render_width, render_height, rgba);
+    samples.push_back(renderer.GetSeconds() * 1e9 / renderer.GetNumRays());
+  }
+  return Summarize(samples);
+}
+
+static void WriteStats(std::ostream& out, const char* name, const Stats& s, bool last) {
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "      \"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"mean\": %.1f}%s\n",
+                name, s.p50, s.p90, s.p99, s.mean, last ? "" : ",");
+  out << buf;
+}
+
+//Medians of a previous run, keyed by level and metric. Only reads the layout written above.
+static bool ReadBaseline(const char* fname, std::map<std::pair<int, std::string>, double>& medians) {
+  std::ifstream fin(fname);
+  if (!fin) {
+    return false;
+  }
+  std::string line;
+  int level = -1;
+  while (std::getline(fin, line)) {
+    char name[64];
+    double p50;
+    if (std::sscanf(line.c_str(), " {\"level\": %d", &level) == 1) {
+      continue;
+    } else if (level >= 0 && std::sscanf(line.c_str(), " \"%63[^\"]\": {\"p50\": %lf", name, &p50) == 2) {
+      medians[std::make_pair(level, std::string(name))] = p50;
+    }
+  }
+  return !medians.empty();
+}
+
+int main(int argc, char *argv[]) {
+  int ticks = default_ticks;
+  float tolerance = default_tolerance;
+  const char* out_fname = nullptr;
+  const char* baseline_fname = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+      ticks = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_fname = argv[++i];
+    } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_fname = argv[++i];
+    } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = (float)std::atof(argv[++i]);
+    } else {
+      std::cerr << "Usage: marble_bench [--ticks N] [--out file.json] [--baseline file.json] [--tolerance 0.15]" << std::endl;
+      return 2;
+    }
+  }
+
+  //Run everything and collect the medians for the baseline check
+  std::ostringstream json;
+  std::map<std::pair<int, std::string>, double> medians;
+  json << "{\n  \"simd\": \"" << FractalBatchPath() << "\",\n  \"ticks\": " << ticks << ",\n  \"levels\": [\n";
+  for (int lv = 0; lv < num_levels; ++lv) {
+    const Level& level = all_levels[lv];
+    Kernel kernel;
+    kernel.Build(level.params);
+    const std::vector<Eigen::Vector3f> pts = SurfacePoints(kernel, level, 1000 + lv);
+    std::cerr << "Level " << (lv + 1) << ": " << pts.size() << " points" << std::endl;
+
+    const char* names[] = {"de", "de_batch", "np", "collision", "tick_fixed", "tick_adaptive", "render_ray"};
+    const int num_stats = sizeof(names) / sizeof(names[0]);
+    Stats stats[num_stats];
+    stats[0] = BenchDE(kernel, pts);
+    stats[1] = BenchDEBatch(level, pts);
+    stats[2] = BenchNP(kernel, pts);
+    stats[3] = BenchCollision(kernel, level, pts);
+    stats[4] = BenchTick(kernel, level, MarbleSim::PHYS_FIXED, ticks);
+    stats[5] = BenchTick(kernel, level, MarbleSim::PHYS_ADAPTIVE, ticks);
+    stats[6] = BenchRender(level);
+
+    json << "    {\"level\": " << lv << ", \"points\": " << pts.size() << ", \"ns\": {\n";
+    for (int i = 0; i < num_stats; ++i) {
+      WriteStats(json, names[i], stats[i], i == num_stats - 1);
+      medians[std::make_pair(lv, std::string(names[i]))] = stats[i].p50;
+    }
+    json << "    }}" << (lv + 1 < num_levels ? "," : "") << "\n";
+  }
+  json << "  ]\n}\n";
+
+  std::cout << json.str();
+  if (out_fname) {
+    std::ofstream fout(out_fname);
+    fout << json.str();
+  }
+
+  //Compare medians against the baseline
+  if (baseline_fname) {
+    std::map<std::pair<int, std::string>, double> base;
+    if (!ReadBaseline(baseline_fname, base)) {
+      std::cerr << "Could not read baseline " << baseline_fname << std::endl;
+      return 2;
+    }
+    int regressions = 0;
+    for (std::map<std::pair<int, std::string>, double>::const_iterator it = base.begin(); it != base.end(); ++it) {
+      const std::map<std::pair<int, std::string>, double>::const_iterator cur = medians.find(it->first);
+      if (cur != medians.end() && cur->second > it->second * (1.0 + tolerance)) {
+        std::cerr << "Regression: level " << (it->first.first + 1) << " " << it->first.second << " "
+                  << it->second << " ns -> " << cur->second << " ns" << std::endl;
+        regressions += 1;
+      }
+    }
+    std::cerr << regressions << " regressions beyond " << (tolerance * 100.0f) << "%" << std::endl;
+    return regressions > 0 ? 1 : 0;
+  }
+  return 0;
+}
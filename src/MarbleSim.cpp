@@ -0,0 +1,347 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MarbleSim.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+
+static const float ground_force = 0.008f;
+static const float air_force = 0.004f;
+static const float ground_friction = 0.99f;
+static const float air_friction = 0.995f;
+static const int num_phys_steps = 6;
+static const int max_adaptive_steps = 16;
+static const float contact_step = 0.25f; //Max step while touching, relative to marble radius
+static const float marble_bounce = 1.2f; //Range 1.0 to 2.0
+static const float gravity = 0.005f;
+static const float ground_ratio = 1.15f;
+static const int min_marbles_per_thread = 256; //About 0.3 ms of ticks, far more than waking a worker
+
+MarbleState::MarbleState() :
+  pos(0.0f, 0.0f, 0.0f),
+  vel(0.0f, 0.0f, 0.0f),
+  rad(1.0f),
+  last_de(0.0f),
+  last_de_pos(0.0f, 0.0f, 0.0f),
+  last_de_reach(0.0f),
+  last_de_params(FractalParams::Ones()),
+  de_evals(0),
+  de_skips(0) {
+}
+
+static bool MarbleCollision(const MarbleSim::Kernel& kernel, MarbleState& m, MarbleTick& tick) {
+  //Skip the distance estimate entirely while the marble is known to be in free space
+  if (MarbleSim::FreeSpace(kernel, m) >= m.rad * ground_ratio) {
+    m.de_skips += 1;
+    return false;
+  }
+
+  //Check if the distance estimate indicates a collision
+  const MarbleSim::Collision col = MarbleSim::CollisionQuery(kernel, m.rad, m.pos);
+  m.de_evals += 1;
+  m.last_de = col.de;
+  m.last_de_pos = m.pos;
+  m.last_de_reach = col.reach;
+  m.last_de_params = kernel.GetParams();
+  if (col.de >= m.rad) {
+    return col.de < m.rad * ground_ratio;
+  }
+
+  //Check if the marble has been crushed by the fractal
+  if (col.crushed) {
+    m.pos.y() = -9999.0f;
+    tick.crushed = true;
+    return false;
+  }
+
+  //Compute offset from the nearest point
+  const Eigen::Vector3f d = col.np - m.pos;
+  const Eigen::Vector3f dn = -col.normal;
+
+  //Apply the offset to the marble's position and velocity
+  const float dv = m.vel.dot(dn);
+  tick.max_delta_v = std::max(tick.max_delta_v, dv);
+  m.pos -= dn * m.rad - d;
+  m.vel -= dn * (dv * marble_bounce);
+
+  //Now touching the nearest point. Every folded point moved at most scale^k times as
+  //far as the marble, which adds that distance per iteration to the reach.
+  m.last_de = m.rad;
+  m.last_de_reach += float(fractal_iters) * (m.pos - m.last_de_pos).norm();
+  m.last_de_pos = m.pos;
+  return true;
+}
+
+MarbleTick MarbleSim::Tick(const Kernel& kernel, const Level& level, PhysMode mode,
+                           MarbleState& m, const Eigen::Vector3f& push) {
+  MarbleTick tick;
+  tick.on_ground = false;
+  tick.crushed = false;
+  tick.max_delta_v = 0.0f;
+
+  //Fixed substeps are safe until one of them moves the marble further than a contact
+  //step, past that a thin wall can be skipped entirely so go adaptive
+  if (mode == PHYS_AUTO) {
+    const float max_fixed_speed = m.rad * contact_step * num_phys_steps;
+    mode = (m.vel.norm() > max_fixed_speed ? PHYS_ADAPTIVE : PHYS_FIXED);
+  }
+
+  //Apply all physics (gravity and collision)
+  if (mode == PHYS_ADAPTIVE) {
+    float t = 0.0f;
+    for (int i = 0; i < max_adaptive_steps && t < 1.0f; ++i) {
+      //Nothing is closer than the free space, so the marble can move that far freely.
+      //When touching, allow a small step anyway and let the collision push it back out.
+      const float max_move = std::max(FreeSpace(kernel, m) - m.rad, m.rad * contact_step);
+      const float max_speed = m.vel.norm() + m.rad * gravity;
+      float dt = 1.0f - t;
+      if (i < max_adaptive_steps - 1 && max_speed * dt > max_move) {
+        dt = max_move / max_speed;
+      }
+      const float force = m.rad * gravity * dt;
+      if (level.planet) {
+        m.vel -= m.pos.normalized() * force;
+      } else {
+        m.vel.y() -= force;
+      }
+      m.pos += m.vel * dt;
+      tick.on_ground |= MarbleCollision(kernel, m, tick);
+      t += dt;
+    }
+  } else {
+    for (int i = 0; i < num_phys_steps; ++i) {
+      const float force = m.rad * gravity / num_phys_steps;
+      if (level.planet) {
+        m.vel -= m.pos.normalized() * force;
+      } else {
+        m.vel.y() -= force;
+      }
+      m.pos += m.vel / num_phys_steps;
+      tick.on_ground |= MarbleCollision(kernel, m, tick);
+    }
+  }
+
+  //Add input force
+  const float f = m.rad * (tick.on_ground ? ground_force : air_force);
+  m.vel += push * f;
+
+  //Apply friction
+  m.vel *= (tick.on_ground ? ground_friction : air_friction);
+  return tick;
+}
+
+MarbleSim::Collision MarbleSim::CollisionQuery(const Kernel& kernel, float rad, const Eigen::Vector3f& pt) {
+  //One forward fold gives the distance and the decisions to unfold the nearest point
+  Kernel::Folded folded;
+  kernel.Fold(pt, folded);
+
+  Collision col;
+  col.de = kernel.DE(folded);
+  col.reach = folded.reach;
+  col.crushed = col.de < rad * 0.001f;
+  if (col.de < rad && !col.crushed) {
+    col.np = kernel.NP(folded);
+    col.normal = (pt - col.np).normalized();
+  } else {
+    col.np = pt;
+    col.normal.setZero();
+  }
+  return col;
+}
+
+float MarbleSim::FreeSpace(const Kernel& kernel, const MarbleState& m) {
+  //The distance estimate can't shrink faster than the marble moves
+  const float moved = (m.pos - m.last_de_pos).norm();
+  float space = m.last_de - moved;
+
+  //Animated levels only change angle1, angle2 and offset_y, which can only move the
+  //estimate as far as FractalKernel::ShiftReach says. Anything else changing means the
+  //old estimate says nothing about the new fractal. The reach was measured at
+  //last_de_pos and grows by at most the distance moved per iteration, like after a push.
+  const FractalParams& cur = kernel.GetParams();
+  for (int i = 0; i < num_fractal_params; ++i) {
+    if (i != 1 && i != 2 && i != 4 && cur[i] != m.last_de_params[i]) {
+      return -FLT_MAX;
+    }
+  }
+  const float da = std::abs(cur[1] - m.last_de_params[1]) + std::abs(cur[2] - m.last_de_params[2]);
+  const float ds = std::abs(cur[4] - m.last_de_params[4]);
+  const float reach = m.last_de_reach + float(fractal_iters) * moved;
+  space -= da * reach + ds * kernel.ShiftReach();
+  return space;
+}
+
+bool MarbleSim::HitFlag(const Level& level, const Eigen::Vector3f& flag_pos, const MarbleState& m) {
+  const bool flag_y_match = level.planet ?
+    m.pos.y() <= flag_pos.y() && m.pos.y() >= flag_pos.y() - 7*m.rad :
+    m.pos.y() >= flag_pos.y() && m.pos.y() <= flag_pos.y() + 7*m.rad;
+  if (flag_y_match) {
+    const float fx = m.pos.x() - flag_pos.x();
+    const float fz = m.pos.z() - flag_pos.z();
+    return fx*fx + fz*fz < 6 * m.rad*m.rad;
+  }
+  return false;
+}
+
+void MarbleSim::Animate(const Level& level, int timer, FractalParams& params) {
+  params[1] = level.params[1] + level.anim_1 * std::sin(timer * 0.015f);
+  params[2] = level.params[2] + level.anim_2 * std::sin(timer * 0.015f);
+  params[4] = level.params[4] + level.anim_3 * std::sin(timer * 0.015f);
+}
+
+MarbleSim::MarbleSim(int level, PhysMode mode) :
+  cur_level(level),
+  phys_mode(mode),
+  num_threads(0),
+  timer(0),
+  work_generation(0),
+  work_slices(0),
+  work_pending(0),
+  work_quit(false) {
+  Reset(0);
+}
+
+MarbleSim::~MarbleSim() {
+  {
+    std::lock_guard<std::mutex> lock(work_mutex);
+    work_quit = true;
+  }
+  work_start.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
+void MarbleSim::Reset(int n) {
+  const Level& level = all_levels[cur_level];
+  timer = 0;
+  frac_params = level.params;
+  kernel.Build(frac_params);
+
+  const MarbleState m;
+  pos_x.assign(n, level.start_pos.x());
+  pos_y.assign(n, level.start_pos.y());
+  pos_z.assign(n, level.start_pos.z());
+  vel_x.assign(n, 0.0f);
+  vel_y.assign(n, 0.0f);
+  vel_z.assign(n, 0.0f);
+  last_de.assign(n, m.last_de);
+  last_de_x.assign(n, m.last_de_pos.x());
+  last_de_y.assign(n, m.last_de_pos.y());
+  last_de_z.assign(n, m.last_de_pos.z());
+  last_de_reach.assign(n, m.last_de_reach);
+  last_de_params.assign(n, m.last_de_params);
+  status.assign(n, (unsigned char)ROLLING);
+  goal_time.assign(n, -1);
+  de_evals.assign(n, 0);
+  de_skips.assign(n, 0);
+}
+
+void MarbleSim::Step(const float* push_x, const float* push_y, const float* push_z) {
+  //Marbles don't interact, so split them into contiguous ranges, one per thread.
+  //Small batches aren't worth waking anyone for.
+  const int n = Size();
+  int threads = (num_threads > 0 ? num_threads : (int)std::thread::hardware_concurrency());
+  threads = std::max(1, std::min(threads, n / min_marbles_per_thread));
+  if (threads == 1) {
+    StepRange(0, n, push_x, push_y, push_z);
+  } else {
+    {
+      std::lock_guard<std::mutex> lock(work_mutex);
+      while ((int)workers.size() < threads - 1) {
+        workers.push_back(std::thread(&MarbleSim::RunWorker, this, (int)workers.size() + 1, work_generation));
+      }
+      work_push[0] = push_x;
+      work_push[1] = push_y;
+      work_push[2] = push_z;
+      work_slices = threads;
+      work_pending = threads - 1;
+      work_generation += 1;
+    }
+    work_start.notify_all();
+    StepRange(0, n/threads, push_x, push_y, push_z);
+    std::unique_lock<std::mutex> lock(work_mutex);
+    work_done.wait(lock, [this] { return work_pending == 0; });
+  }
+
+  //Update animated fractals, same as the scene does after moving the marble
+  Animate(all_levels[cur_level], timer, frac_params);
+  kernel.Build(frac_params);
+  timer += 1;
+}
+
+void MarbleSim::RunWorker(int index, unsigned long generation) {
+  std::unique_lock<std::mutex> lock(work_mutex);
+  while (true) {
+    work_start.wait(lock, [&] { return work_quit || work_generation != generation; });
+    if (work_quit) { return; }
+    generation = work_generation;
+    if (index >= work_slices) { continue; }
+
+    //Step this worker's slice outside the lock
+    const int n = Size();
+    const int slices = work_slices;
+    const float* push_x = work_push[0];
+    const float* push_y = work_push[1];
+    const float* push_z = work_push[2];
+    lock.unlock();
+    StepRange(n*index/slices, n*(index + 1)/slices, push_x, push_y, push_z);
+    lock.lock();
+    if (--work_pending == 0) {
+      work_done.notify_one();
+    }
+  }
+}
+
+void MarbleSim::StepRange(int begin, int end, const float* push_x, const float* push_y, const float* push_z) {
+  const Level& level = all_levels[cur_level];
+  MarbleState m;
+  m.rad = level.marble_rad;
+  for (int i = begin; i < end; ++i) {
+    if (status[i] != ROLLING) {
+      continue;
+    }
+
+    //Gather the marble, step it with the same code as the scene, and scatter it back
+    m.pos = Eigen::Vector3f(pos_x[i], pos_y[i], pos_z[i]);
+    m.vel = Eigen::Vector3f(vel_x[i], vel_y[i], vel_z[i]);
+    m.last_de = last_de[i];
+    m.last_de_pos = Eigen::Vector3f(last_de_x[i], last_de_y[i], last_de_z[i]);
+    m.last_de_reach = last_de_reach[i];
+    m.last_de_params = last_de_params[i];
+    m.de_evals = de_evals[i];
+    m.de_skips = de_skips[i];
+    Tick(kernel, level, phys_mode, m, Eigen::Vector3f(push_x[i], push_y[i], push_z[i]));
+    pos_x[i] = m.pos.x(); pos_y[i] = m.pos.y(); pos_z[i] = m.pos.z();
+    vel_x[i] = m.vel.x(); vel_y[i] = m.vel.y(); vel_z[i] = m.vel.z();
+    last_de[i] = m.last_de;
+    last_de_x[i] = m.last_de_pos.x(); last_de_y[i] = m.last_de_pos.y(); last_de_z[i] = m.last_de_pos.z();
+    last_de_reach[i] = m.last_de_reach;
+    last_de_params[i] = m.last_de_params;
+    de_evals[i] = m.de_evals;
+    de_skips[i] = m.de_skips;
+
+    //Same end conditions as the scene
+    if (HitFlag(level, level.end_pos, m)) {
+      status[i] = GOAL;
+      goal_time[i] = timer;
+    } else if (m.pos.y() < level.kill_y) {
+      status[i] = DEAD;
+    }
+  }
+}
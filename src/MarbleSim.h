@@ -0,0 +1,142 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Level.h"
+#include "FractalKernel.h"
+#include <Eigen/Dense>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Physics state of a single marble
+struct MarbleState {
+  MarbleState();
+
+  Eigen::Vector3f pos;
+  Eigen::Vector3f vel;
+  float           rad;
+  float           last_de;        //Last evaluated distance estimate
+  Eigen::Vector3f last_de_pos;    //Where it was evaluated
+  float           last_de_reach;  //How far its fractal angles can move it, see FractalKernel::Folded
+  FractalParams   last_de_params; //For which fractal it was evaluated
+  unsigned long   de_evals;       //Collision checks that evaluated the fractal
+  unsigned long   de_skips;       //Collision checks skipped in free space
+};
+
+//Outcome of one physics tick of a single marble
+struct MarbleTick {
+  bool  on_ground;
+  bool  crushed;     //Marble got stuck inside the fractal and was sent below the level
+  float max_delta_v; //Hardest impact, used for bounce sounds
+};
+
+//Marble physics without any rendering or audio. The static functions step one marble
+//and are what Scene uses, an instance steps many marbles on the same level at once.
+class MarbleSim {
+public:
+  typedef FractalKernel<fractal_iters> Kernel;
+
+  enum PhysMode {
+    PHYS_FIXED,    //Always num_phys_steps substeps per tick
+    PHYS_ADAPTIVE, //Conservative advancement using the distance estimate
+    PHYS_AUTO,     //Fixed substeps, adaptive while a substep would move further than a contact step
+  };
+
+  enum Status {
+    ROLLING,
+    GOAL,
+    DEAD,
+  };
+
+  //Everything a collision needs from a single fold of the fractal
+  struct Collision {
+    float de;               //Distance estimate to the fractal
+    Eigen::Vector3f np;     //Nearest point, only set if de < marble radius
+    Eigen::Vector3f normal; //Unit vector from np to the query point
+    bool crushed;           //Marble center is (nearly) inside the fractal
+    float reach;            //Bounds how much the fold angles move de, see FractalKernel::Folded
+  };
+
+  MarbleSim(int level, PhysMode mode=PHYS_FIXED);
+  ~MarbleSim();
+  MarbleSim(const MarbleSim&) = delete;
+  MarbleSim& operator=(const MarbleSim&) = delete;
+
+  //Put n marbles at the start of the level and restart its animation
+  void Reset(int n);
+  //Number of threads Step may use, 0 uses one per core. The workers are
+  //started on the first Step that needs them and kept until destruction.
+  void SetThreads(int n) { num_threads = n; }
+
+  //Advance every rolling marble by one tick. The push arrays hold the world space
+  //input force of each marble with at most unit length, like the keyboard in Scene.
+  void Step(const float* push_x, const float* push_y, const float* push_z);
+
+  int Size() const { return (int)status.size(); }
+  int GetTimer() const { return timer; }
+  const float* PosX() const { return pos_x.data(); }
+  const float* PosY() const { return pos_y.data(); }
+  const float* PosZ() const { return pos_z.data(); }
+  Status GetStatus(int i) const { return (Status)status[i]; }
+  int GetGoalTime(int i) const { return goal_time[i]; }
+  unsigned long GetDEEvals(int i) const { return de_evals[i]; }
+  unsigned long GetDESkips(int i) const { return de_skips[i]; }
+
+  //Single marble physics, shared with Scene so both give identical results
+  static MarbleTick Tick(const Kernel& kernel, const Level& level, PhysMode mode,
+                         MarbleState& m, const Eigen::Vector3f& push);
+  static Collision CollisionQuery(const Kernel& kernel, float rad, const Eigen::Vector3f& pt);
+  static float FreeSpace(const Kernel& kernel, const MarbleState& m);
+  static bool HitFlag(const Level& level, const Eigen::Vector3f& flag_pos, const MarbleState& m);
+  static void Animate(const Level& level, int timer, FractalParams& params);
+
+protected:
+  void StepRange(int begin, int end, const float* push_x, const float* push_y, const float* push_z);
+  void RunWorker(int index, unsigned long generation);
+
+private:
+  int             cur_level;
+  PhysMode        phys_mode;
+  int             num_threads;
+  int             timer;
+  FractalParams   frac_params;
+  Kernel          kernel;
+
+  //Marble state, one entry per marble
+  std::vector<float>         pos_x, pos_y, pos_z;
+  std::vector<float>         vel_x, vel_y, vel_z;
+  std::vector<float>         last_de;
+  std::vector<float>         last_de_x, last_de_y, last_de_z;
+  std::vector<float>         last_de_reach;
+  std::vector<FractalParams> last_de_params;
+  std::vector<unsigned char> status;
+  std::vector<int>           goal_time;
+  std::vector<unsigned long> de_evals;
+  std::vector<unsigned long> de_skips;
+
+  //Worker pool, each Step hands slice i of work_slices to worker i - 1
+  std::vector<std::thread>   workers;
+  std::mutex                 work_mutex;
+  std::condition_variable    work_start;
+  std::condition_variable    work_done;
+  unsigned long              work_generation;
+  int                        work_slices;
+  int                        work_pending;
+  const float*               work_push[3];
+  bool                       work_quit;
+};
@@ -0,0 +1,155 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Level.h"
+#include "FractalKernel.h"
+#include "MarbleSim.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Runs the nearest point and collision queries of every level from many threads at once
+//and checks that each result is bit for bit what a single thread got. Returns non-zero
+//on any difference.
+//
+//  np_stress_test [--threads N] [--rounds N]
+
+static const int num_points = 512;      //Points near the surface per level
+static const float near_surface = 2.0f; //Max distance of sample points, in marble radii
+static const int default_threads = 8;
+static const int default_rounds = 20;   //Passes over all levels per thread
+
+typedef MarbleSim::Kernel Kernel;
+
+//Everything one query returns, compared as raw bits
+struct Result {
+  float np[3];
+  float col_de;
+  float col_np[3];
+  float col_normal[3];
+  int   col_crushed;
+};
+
+struct LevelData {
+  Kernel kernel;
+  float rad;
+  std::vector<Eigen::Vector3f> pts;
+  std::vector<Result> expected;
+};
+
+//Fixed, seeded points close enough to the fractal that NP is actually used
+static std::vector<Eigen::Vector3f> SurfacePoints(const Kernel& kernel, const Level& level, int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+  std::vector<Eigen::Vector3f> pts;
+  for (int tries = 0; tries < num_points * 1000 && (int)pts.size() < num_points; ++tries) {
+    const Eigen::Vector3f p = level.start_pos + Eigen::Vector3f(u(rng), u(rng), u(rng)) * (60.0f * level.marble_rad);
+    if (kernel.DE(p) < near_surface * level.marble_rad) {
+      pts.push_back(p);
+    }
+  }
+  return pts;
+}
+
+static Result Query(const Kernel& kernel, float rad, const Eigen::Vector3f& pt) {
+  Result r;
+  std::memset(&r, 0, sizeof(r));
+  Kernel::Folded folded;
+  kernel.Fold(pt, folded);
+  const Eigen::Vector3f np = kernel.NP(folded);
+  const MarbleSim::Collision col = MarbleSim::CollisionQuery(kernel, rad, pt);
+  for (int i = 0; i < 3; ++i) {
+    r.np[i] = np[i];
+    r.col_np[i] = col.np[i];
+    r.col_normal[i] = col.normal[i];
+  }
+  r.col_de = col.de;
+  r.col_crushed = (col.crushed ? 1 : 0);
+  return r;
+}
+
+//Each thread starts on a different level and point so they overlap on shared kernels
+static void Worker(const std::vector<LevelData>& levels, int id, int rounds, std::atomic<int>& mismatches) {
+  for (int round = 0; round < rounds; ++round) {
+    for (int l = 0; l < (int)levels.size(); ++l) {
+      const LevelData& data = levels[(l + id) % levels.size()];
+      const int n = (int)data.pts.size();
+      for (int i = 0; i < n; ++i) {
+        const int j = (i + id * 37) % n;
+        const Result r = Query(data.kernel, data.rad, data.pts[j]);
+        if (std::memcmp(&r, &data.expected[j], sizeof(Result)) != 0) {
+          mismatches += 1;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int threads = default_threads;
+  int rounds = default_rounds;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+      rounds = std::max(1, std::atoi(argv[++i]));
+    } else {
+      std::cerr << "Usage: np_stress_test [--threads N] [--rounds N]" << std::endl;
+      return 2;
+    }
+  }
+
+  //Single threaded reference results
+  std::vector<LevelData> levels(num_levels);
+  int total_points = 0;
+  int near_points = 0;
+  for (int lv = 0; lv < num_levels; ++lv) {
+    LevelData& data = levels[lv];
+    data.kernel.Build(all_levels[lv].params);
+    data.rad = all_levels[lv].marble_rad;
+    data.pts = SurfacePoints(data.kernel, all_levels[lv], 2000 + lv);
+    for (size_t i = 0; i < data.pts.size(); ++i) {
+      data.expected.push_back(Query(data.kernel, data.rad, data.pts[i]));
+      near_points += (data.expected.back().col_de < data.rad ? 1 : 0);
+    }
+    total_points += (int)data.pts.size();
+  }
+  if (near_points == 0) {
+    std::cerr << "No points within a marble radius of the fractal" << std::endl;
+    return 1;
+  }
+
+  //The same queries from every thread at once
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.push_back(std::thread(Worker, std::cref(levels), t, rounds, std::ref(mismatches)));
+  }
+  for (size_t t = 0; t < workers.size(); ++t) {
+    workers[t].join();
+  }
+
+  const long queries = (long)total_points * rounds * threads;
+  std::cout << threads << " threads ran " << queries << " queries on " << total_points
+            << " points (" << near_points << " touching): " << mismatches.load() << " mismatches" << std::endl;
+  return (mismatches.load() == 0 ? 0 : 1);
+}
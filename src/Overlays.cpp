@@ -16,10 +16,25 @@
 */
 #include "Overlays.h"
 #include "Level.h"
+#include "Quality.h"
 #include "Res.h"
 #include "Scores.h"
 
 static const float pi = 3.14159265359f;
+static const sf::Color hover_color(255, 64, 64);
+
+static std::string FormatTime(int t) {
+  //Create timer text
+  char txt[] = "00:00:00";
+  const int t_all = std::min(t, 59 * (60 * 60 + 60 + 1));
+  const int t_ms = t_all % 60;
+  const int t_sec = (t_all / 60) % 60;
+  const int t_min = t_all / (60 * 60);
+  txt[0] = '0' + t_min / 10; txt[1] = '0' + t_min % 10;
+  txt[3] = '0' + t_sec / 10; txt[4] = '0' + t_sec % 10;
+  txt[6] = '0' + t_ms / 10;  txt[7] = '0' + t_ms % 10;
+  return txt;
+}
 int mouse_setting = 0;
 bool music_on = true;
 
@@ -27,20 +42,28 @@ Overlays::Overlays(const sf::Font* _font, const sf::Font* _font_mono) :
   font(_font),
   font_mono(_font_mono),
   draw_scale(1.0f),
-  top_level(true) {
+  top_level(true),
+  last_sound_t(-1) {
   memset(all_hover, 0, sizeof(all_hover));
-  buff_hover.loadFromFile(menu_hover_wav);
-  sound_hover.setBuffer(buff_hover);
-  buff_click.loadFromFile(menu_click_wav);
-  sound_click.setBuffer(buff_click);
-  buff_count.loadFromFile(count_down_wav);
-  sound_count.setBuffer(buff_count);
-  buff_go.loadFromFile(count_go_wav);
-  sound_go.setBuffer(buff_go);
-  arrow_tex.loadFromFile(arrow_png);
-  arrow_tex.setSmooth(true);
-  arrow_spr.setTexture(arrow_tex);
-  arrow_spr.setOrigin(arrow_spr.getLocalBounds().width / 2, arrow_spr.getLocalBounds().height / 2);
+  memset(all_dirty, 1, sizeof(all_dirty));
+  all_text[TITLE].setLineSpacing(0.76f);
+  all_text[CREDITS].setLineSpacing(0.9f);
+  all_text[CONTROLS_L].setLineSpacing(1.1f);
+  all_text[CONTROLS_R].setLineSpacing(1.1f);
+  all_text[CONGRATS].setLineSpacing(1.3f);
+  sound_hover.Load(menu_hover_wav);
+  sound_click.Load(menu_click_wav);
+  sound_count.Load(count_down_wav);
+  sound_go.Load(count_go_wav);
+  arrow_img.Load(arrow_png);
+}
+
+void Overlays::SetScale(float scale) {
+  if (scale != draw_scale) {
+    draw_scale = scale;
+    memset(all_dirty, 1, sizeof(all_dirty));
+  }
+  hud.Prewarm(scale);
 }
 
 Overlays::Texts Overlays::GetOption(Texts from, Texts to) {
@@ -55,15 +78,13 @@ Overlays::Texts Overlays::GetOption(Texts from, Texts to) {
 
 void Overlays::UpdateMenu(float mouse_x, float mouse_y) {
   //Update text boxes
-  MakeText("Marble\nMarcher", 60, 20, 72, sf::Color::White, all_text[TITLE]);
-  MakeText("Play", 80, 230, 60, sf::Color::White, all_text[PLAY]);
-  MakeText("Levels", 80, 300, 60, sf::Color::White, all_text[LEVELS]);
-  MakeText("Controls", 80, 370, 60, sf::Color::White, all_text[CONTROLS]);
-  MakeText("Screen Saver", 80, 440, 60, sf::Color::White, all_text[SCREEN_SAVER]);
-  MakeText("Exit", 80, 510, 60, sf::Color::White, all_text[EXIT]);
-  MakeText("\xA9""2019 CodeParade\nMusic by PettyTheft", 16, 652, 32, sf::Color::White, all_text[CREDITS], true);
-  all_text[TITLE].setLineSpacing(0.76f);
-  all_text[CREDITS].setLineSpacing(0.9f);
+  SetText(TITLE, "Marble\nMarcher", 60, 20, 72);
+  SetText(PLAY, "Play", 80, 230, 60);
+  SetText(LEVELS, "Levels", 80, 300, 60);
+  SetText(CONTROLS, "Controls", 80, 370, 60);
+  SetText(SCREEN_SAVER, "Screen Saver", 80, 440, 60);
+  SetText(EXIT, "Exit", 80, 510, 60);
+  SetText(CREDITS, "\xA9""2019 CodeParade\nMusic by PettyTheft", 16, 652, 32, sf::Color::White, true);
 
   //Check if mouse intersects anything
   UpdateHover(PLAY, EXIT, mouse_x, mouse_y);
@@ -71,13 +92,9 @@ void Overlays::UpdateMenu(float mouse_x, float mouse_y) {
 
 void Overlays::UpdateControls(float mouse_x, float mouse_y) {
   //Update text boxes
-  MakeText("Roll\nCamera\nZoom\nRestart\nPause", 40, 200, 46, sf::Color::White, all_text[CONTROLS_L]);
-  MakeText("WASD or Arrows\nMouse\nScroll Wheel\nR or Right-Click\nEsc", 280, 200, 46, sf::Color::White, all_text[CONTROLS_R]);
-  MakeText("Back", 60, 550, 40, sf::Color::White, all_text[BACK]);
-
-  //A little extra vertical spacing
-  all_text[CONTROLS_L].setLineSpacing(1.1f);
-  all_text[CONTROLS_R].setLineSpacing(1.1f);
+  SetText(CONTROLS_L, "Roll\nCamera\nZoom\nRestart\nPause", 40, 200, 46);
+  SetText(CONTROLS_R, "WASD or Arrows\nMouse\nScroll Wheel\nR or Right-Click\nEsc", 280, 200, 46);
+  SetText(BACK, "Back", 60, 550, 40);
 
   //Check if mouse intersects anything
   UpdateHover(BACK, BACK, mouse_x, mouse_y);
@@ -89,11 +106,18 @@ void Overlays::UpdateLevels(float mouse_x, float mouse_y) {
     const float y = 80.0f + float(i/3) * 120.0f;
     const float x = 240.0f + float(i%3) * 400.0f;
     const char* txt = high_scores.HasUnlocked(i) ? all_levels[i].txt : "???";
-    MakeText(txt, x, y, 32, sf::Color::White, all_text[i + L0]);
-    const sf::FloatRect text_bounds = all_text[i + L0].getLocalBounds();
-    all_text[i + L0].setOrigin(text_bounds.width / 2, text_bounds.height / 2);
+    if (SetText(Texts(i + L0), txt, x, y, 32)) {
+      const sf::FloatRect text_bounds = all_text[i + L0].getLocalBounds();
+      all_text[i + L0].setOrigin(text_bounds.width / 2, text_bounds.height / 2);
+    }
+
+    //Best time, left empty until the level is completed
+    const float time_y = 98.0f + float(i / 3) * 120.0f;
+    const float time_x = 148.0f + float(i % 3) * 400.0f;
+    const std::string time_txt = high_scores.HasCompleted(i) ? FormatTime(high_scores.Get(i)) : "";
+    SetText(Texts(i + T0), time_txt, time_x, time_y, 48, sf::Color(64, 255, 64), true);
   }
-  MakeText("Back", 590, 660, 40, sf::Color::White, all_text[BACK2]);
+  SetText(BACK2, "Back", 590, 660, 40);
 
   //Check if mouse intersects anything
   UpdateHover(L0, BACK2, mouse_x, mouse_y);
@@ -101,14 +125,14 @@ void Overlays::UpdateLevels(float mouse_x, float mouse_y) {
 
 void Overlays::UpdatePaused(float mouse_x, float mouse_y) {
   //Update text boxes
-  MakeText("Paused", 540, 288, 54, sf::Color::White, all_text[PAUSED]);
-  MakeText("Continue", 370, 356, 40, sf::Color::White, all_text[CONTINUE]);
-  MakeText("Restart", 620, 356, 40, sf::Color::White, all_text[RESTART]);
-  MakeText("Quit", 845, 356, 40, sf::Color::White, all_text[QUIT]);
+  SetText(PAUSED, "Paused", 540, 288, 54);
+  SetText(CONTINUE, "Continue", 370, 356, 40);
+  SetText(RESTART, "Restart", 620, 356, 40);
+  SetText(QUIT, "Quit", 845, 356, 40);
 
   //Update music setting
   const char* music_txt = (music_on ? "Music:  On" : "Music:  Off");
-  MakeText(music_txt, 410, 500, 40, sf::Color::White, all_text[MUSIC]);
+  SetText(MUSIC, music_txt, 410, 500, 40);
 
   //Update mouse sensitivity setting
   const char* mouse_txt = "Mouse Sensitivity:  High";
@@ -117,108 +141,133 @@ void Overlays::UpdatePaused(float mouse_x, float mouse_y) {
   } else if (mouse_setting == 2) {
     mouse_txt = "Mouse Sensitivity:  Low";
   }
-  MakeText(mouse_txt, 410, 550, 40, sf::Color::White, all_text[MOUSE]);
+  SetText(MOUSE, mouse_txt, 410, 550, 40);
+
+  //Update render quality setting
+  const std::string quality_txt = std::string("Quality:  ") + all_quality[quality_setting].name;
+  SetText(QUALITY, quality_txt, 410, 600, 40);
 
   //Check if mouse intersects anything
-  UpdateHover(CONTINUE, MOUSE, mouse_x, mouse_y);
+  UpdateHover(CONTINUE, QUALITY, mouse_x, mouse_y);
 }
 
 void Overlays::DrawMenu(sf::RenderWindow& window) {
-  for (int i = TITLE; i <= CREDITS; ++i) {
-    window.draw(all_text[i]);
-  }
+  DrawBatch(window, menu_batch, TITLE, CREDITS);
 }
 
 void Overlays::DrawControls(sf::RenderWindow& window) {
-  for (int i = CONTROLS_L; i <= BACK; ++i) {
-    window.draw(all_text[i]);
-  }
+  DrawBatch(window, controls_batch, CONTROLS_L, BACK);
 }
 
-void Overlays::DrawTimer(sf::RenderWindow& window, int t, bool is_high_score) {
-  sf::Text text;
+void Overlays::DrawTimer(int t, bool is_high_score) {
+  sf::Text& text = all_text[TIMER];
+  if (t < last_sound_t) {
+    //Countdown restarted
+    last_sound_t = -1;
+  }
+
+  //A frame can cover several ticks or none, so a sound plays when the drawn
+  //tick has crossed into a new second since the last frame
+  const int second = (t < 0 ? -1 : t / 60);
+  const bool new_second = (second != (last_sound_t < 0 ? -1 : last_sound_t / 60));
+  last_sound_t = t;
   if (t < 0) {
     return;
   } else if (t < 3*60) {
     //Create text for the number
     char txt[] = "0";
     txt[0] = '3' - (t / 60);
-    MakeText(txt, 640, 50, 140, sf::Color::White, text);
+    if (SetText(TIMER, txt, 640, 50, hud_countdown_size)) {
+      const sf::FloatRect text_bounds = text.getLocalBounds();
+      text.setOrigin(text_bounds.width / 2, text_bounds.height / 2);
+    }
 
     //Play count sound if needed
-    if (t % 60 == 0) {
+    if (new_second) {
       sound_count.play();
     }
   } else if (t < 4*60) {
-    MakeText("GO!", 640, 50, 140, sf::Color::White, text);
+    if (SetText(TIMER, "GO!", 640, 50, hud_countdown_size)) {
+      const sf::FloatRect text_bounds = text.getLocalBounds();
+      text.setOrigin(text_bounds.width / 2, text_bounds.height / 2);
+    }
 
     //Play go sound if needed
-    if (t == 3*60) {
+    if (new_second) {
       sound_go.play();
     }
   } else {
-    //Create timer text
+    //Create timer text, undoing the countdown animation
     const int score = t - 3 * 60;
-    const sf::Color col = (is_high_score ? sf::Color::Green : sf::Color::White);
-    MakeTime(score, 530, 10, 60, col, text);
+    if (SetText(TIMER, FormatTime(score), 530, 10, hud_timer_size, sf::Color::White, true)) {
+      text.setOrigin(0.0f, 0.0f);
+      text.setScale(1.0f, 1.0f);
+    }
+    text.setFillColor(is_high_score ? sf::Color::Green : sf::Color::White);
   }
 
   if (t < 4*60) {
-    //Apply zoom animation
+    //Apply zoom animation (transform and color only, the glyphs stay)
     const float fpart = float(t % 60) / 60.0f;
     const float zoom = 0.8f + fpart*0.2f;
     const sf::Uint8 alpha = sf::Uint8(255.0f*(1.0f - fpart*fpart));
     text.setScale(sf::Vector2f(zoom, zoom));
     text.setFillColor(sf::Color(255, 255, 255, alpha));
     text.setOutlineColor(sf::Color(0, 0, 0, alpha));
-
-    //Center text
-    const sf::FloatRect text_bounds = text.getLocalBounds();
-    text.setOrigin(text_bounds.width / 2, text_bounds.height / 2);
   }
 
-  //Draw the text
-  window.draw(text);
+  hud.Add(text);
 }
 
-void Overlays::DrawLevelDesc(sf::RenderWindow& window, int level) {
-  sf::Text text;
-  MakeText(all_levels[level].txt, 640, 60, 48, sf::Color::White, text);
-  const sf::FloatRect text_bounds = text.getLocalBounds();
-  text.setOrigin(text_bounds.width / 2, text_bounds.height / 2);
-  window.draw(text);
+void Overlays::DrawLevelDesc(int level) {
+  sf::Text& text = all_text[LEVEL_DESC];
+  if (SetText(LEVEL_DESC, all_levels[level].txt, 640, 60, hud_desc_size)) {
+    const sf::FloatRect text_bounds = text.getLocalBounds();
+    text.setOrigin(text_bounds.width / 2, text_bounds.height / 2);
+  }
+  hud.Add(text);
 }
 
-void Overlays::DrawFPS(sf::RenderWindow& window, int fps) {
-  sf::Text text;
-  std::string fps_str = std::to_string(fps) + "fps";
+void Overlays::DrawFPS(int fps) {
+  sf::Text& text = all_text[FPS];
   const sf::Color col = (fps < 50 ? sf::Color::Red : sf::Color::White);
-  MakeText(fps_str.c_str(), 1280, 720, 24, col, text, false);
-  const sf::FloatRect text_bounds = text.getLocalBounds();
-  text.setOrigin(text_bounds.width, text_bounds.height);
-  window.draw(text);
+  if (SetText(FPS, std::to_string(fps) + "fps", 1280, 720, hud_fps_size, col)) {
+    const sf::FloatRect text_bounds = text.getLocalBounds();
+    text.setOrigin(text_bounds.width, text_bounds.height);
+  }
+  hud.Add(text);
 }
 
 void Overlays::DrawPaused(sf::RenderWindow& window) {
-  for (int i = PAUSED; i <= MOUSE; ++i) {
-    window.draw(all_text[i]);
-  }
+  DrawBatch(window, paused_batch, PAUSED, QUALITY);
 }
 
-void Overlays::DrawArrow(sf::RenderWindow& window, const sf::Vector3f& v3) {
+void Overlays::DrawArrow(const sf::Vector3f& v3) {
   const float x_scale = 250.0f * v3.y + 520.0f * (1.0f - v3.y);
   const float x = 640.0f + x_scale * std::cos(v3.x);
   const float y = 360.0f + 250.0f * std::sin(v3.x);
   const sf::Uint8 alpha = sf::Uint8(102.0f * std::max(0.0f, std::min(1.0f, (v3.z - 5.0f) / 30.0f)));
+  if (alpha > 0 && arrow_tex.getSize().x == 0) {
+    //Upload the arrow the first time it's needed, the image loads in the background
+    if (!arrow_img.IsReady() || !arrow_img.Wait()) { return; }
+    arrow_tex.loadFromImage(arrow_img.Get());
+    arrow_tex.setSmooth(true);
+    arrow_spr.setTexture(arrow_tex, true);
+    arrow_spr.setOrigin(arrow_spr.getLocalBounds().width / 2, arrow_spr.getLocalBounds().height / 2);
+  }
   if (alpha > 0) {
     arrow_spr.setScale(draw_scale * 0.1f, draw_scale * 0.1f);
     arrow_spr.setRotation(90.0f + v3.x * 180.0f / pi);
     arrow_spr.setPosition(draw_scale * x, draw_scale * y);
     arrow_spr.setColor(sf::Color(255, 255, 255, alpha));
-    window.draw(arrow_spr);
+    hud.Add(arrow_spr);
   }
 }
 
+void Overlays::DrawHud(sf::RenderWindow& window) {
+  hud.Draw(window);
+}
+
 void Overlays::DrawCredits(sf::RenderWindow& window) {
   const char* txt =
     "Congratulations, you beat all the levels!\n\n"
@@ -227,64 +276,90 @@ void Overlays::DrawCredits(sf::RenderWindow& window) {
     "this game and other projects, check out my\n"
     "YouTube channel \"CodeParade\".\n\n"
     "Thanks for playing!";
-  sf::Text text;
-  MakeText(txt, 50, 100, 44, sf::Color::White, text);
-  text.setLineSpacing(1.3f);
-  window.draw(text);
+  SetText(CONGRATS, txt, 50, 100, 44);
+  DrawBatch(window, credits_batch, CONGRATS, CONGRATS);
 }
 
 void Overlays::DrawLevels(sf::RenderWindow& window) {
-  //Draw the level names
-  for (int i = L0; i <= BACK2; ++i) {
-    window.draw(all_text[i]);
-  }
-  //Draw the times
-  for (int i = 0; i < num_levels; ++i) {
-    if (high_scores.HasCompleted(i)) {
-      sf::Text text;
-      const float y = 98.0f + float(i / 3) * 120.0f;
-      const float x = 148.0f + float(i % 3) * 400.0f;
-      MakeTime(high_scores.Get(i), x, y, 48, sf::Color(64, 255, 64), text);
-      window.draw(text);
-    }
-  }
+  //Level names and best times, filled in by UpdateLevels
+  DrawBatch(window, levels_batch, L0, T14);
 }
 
-void Overlays::MakeText(const char* str, float x, float y, float size, const sf::Color& color, sf::Text& text, bool mono) {
+void Overlays::MakeText(const char* str, float x, float y, float size, const sf::Color& color, const sf::Font& font, sf::Text& text) {
   text.setString(str);
-  text.setFont(mono ? *font_mono : *font);
+  text.setFont(font);
   text.setCharacterSize(int(size * draw_scale));
   text.setLetterSpacing(0.8f);
   text.setPosition((x - 2.0f) * draw_scale, (y - 2.0f) * draw_scale);
   text.setFillColor(color);
-  text.setOutlineThickness(3.0f * draw_scale);
+  text.setOutlineThickness(text_outline * draw_scale);
   text.setOutlineColor(sf::Color::Black);
 }
 
-void Overlays::MakeTime(int t, float x, float y, float size, const sf::Color& color, sf::Text& text) {
-  //Create timer text
-  char txt[] = "00:00:00";
-  const int t_all = std::min(t, 59 * (60 * 60 + 60 + 1));
-  const int t_ms = t_all % 60;
-  const int t_sec = (t_all / 60) % 60;
-  const int t_min = t_all / (60 * 60);
-  txt[0] = '0' + t_min / 10; txt[1] = '0' + t_min % 10;
-  txt[3] = '0' + t_sec / 10; txt[4] = '0' + t_sec % 10;
-  txt[6] = '0' + t_ms / 10;  txt[7] = '0' + t_ms % 10;
-  MakeText(txt, x, y, size, color, text, true);
-}
-
 void Overlays::UpdateHover(Texts from, Texts to, float mouse_x, float mouse_y) {
   for (int i = from; i <= to; ++i) {
     const sf::FloatRect bounds = all_text[i].getGlobalBounds();
-    if (bounds.contains(mouse_x, mouse_y)) {
-      all_text[i].setFillColor(sf::Color(255, 64, 64));
-      if (!all_hover[i]) {
-        sound_hover.play();
-        all_hover[i] = true;
-      }
-    } else {
-      all_hover[i] = false;
+    const bool hover = bounds.contains(mouse_x, mouse_y);
+    if (hover == all_hover[i]) {
+      continue;
+    }
+    all_text[i].setFillColor(hover ? hover_color : sf::Color::White);
+    BatchOf(Texts(i))->Invalidate();
+    if (hover) {
+      sound_hover.play();
+    }
+    all_hover[i] = hover;
+  }
+}
+
+bool Overlays::SetText(Texts id, const std::string& str, float x, float y, float size, const sf::Color& color, bool mono) {
+  //Also switches to the HUD's fonts once they are prewarmed
+  const sf::Font& font = FontOf(id, mono);
+  if (!all_dirty[id] && all_str[id] == str && all_text[id].getFont() == &font) {
+    return false;
+  }
+  all_str[id] = str;
+  all_dirty[id] = false;
+  MakeText(str.c_str(), x, y, size, color, font, all_text[id]);
+  if (all_hover[id]) {
+    all_text[id].setFillColor(hover_color);
+  }
+  TextBatch* batch = BatchOf(id);
+  if (batch) {
+    batch->Invalidate();
+  }
+  return true;
+}
+
+TextBatch* Overlays::BatchOf(Texts id) {
+  if (id <= CREDITS) {
+    return &menu_batch;
+  } else if (id <= QUALITY) {
+    return &paused_batch;
+  } else if (id <= BACK) {
+    return &controls_batch;
+  } else if (id <= T14) {
+    return &levels_batch;
+  } else if (id == CONGRATS) {
+    return &credits_batch;
+  }
+  //Changes every few frames, drawn on its own
+  return nullptr;
+}
+
+const sf::Font& Overlays::FontOf(Texts id, bool mono) const {
+  if (id >= TIMER && hud.IsReady()) {
+    return hud.GetFont(mono);
+  }
+  return mono ? *font_mono : *font;
+}
+
+void Overlays::DrawBatch(sf::RenderWindow& window, TextBatch& batch, Texts from, Texts to) {
+  if (batch.IsDirty()) {
+    batch.Clear();
+    for (int i = from; i <= to; ++i) {
+      batch.Add(all_text[i]);
     }
   }
+  batch.Draw(window);
 }
@@ -17,6 +17,10 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include "AssetLoader.h"
+#include "Hud.h"
+#include "TextBatch.h"
+#include <string>
 
 extern int mouse_setting;
 extern bool music_on;
@@ -37,6 +41,7 @@ public:
     QUIT,
     MUSIC,
     MOUSE,
+    QUALITY,
     CONTROLS_L,
     CONTROLS_R,
     BACK,
@@ -44,13 +49,20 @@ public:
     L5, L6, L7, L8, L9,
     L10, L11, L12, L13, L14,
     BACK2,
+    T0, T1, T2, T3, T4,
+    T5, T6, T7, T8, T9,
+    T10, T11, T12, T13, T14,
+    CONGRATS,
+    TIMER,
+    LEVEL_DESC,
+    FPS,
     NUM_TEXTS
   };
 
   Overlays(const sf::Font* _font, const sf::Font* _font_mono);
 
   //Relative to 1280x720
-  void SetScale(float scale) { draw_scale = scale; }
+  void SetScale(float scale);
 
   Texts GetOption(Texts from, Texts to);
 
@@ -61,37 +73,54 @@ public:
 
   void DrawMenu(sf::RenderWindow& window);
   void DrawControls(sf::RenderWindow& window);
-  void DrawTimer(sf::RenderWindow& window, int t, bool finished);
-  void DrawLevelDesc(sf::RenderWindow& window, int level);
-  void DrawFPS(sf::RenderWindow& window, int fps);
+  void DrawTimer(int t, bool finished);
+  void DrawLevelDesc(int level);
+  void DrawFPS(int fps);
   void DrawPaused(sf::RenderWindow& window);
-  void DrawArrow(sf::RenderWindow& window, const sf::Vector3f& v3);
+  void DrawArrow(const sf::Vector3f& v3);
   void DrawCredits(sf::RenderWindow& window);
   void DrawLevels(sf::RenderWindow& window);
 
+  //The timer, level text, fps and arrow are queued up and drawn here together
+  void DrawHud(sf::RenderWindow& window);
+
 protected:
-  void MakeText(const char* str, float x, float y, float size, const sf::Color& color, sf::Text& text, bool mono=false);
-  void MakeTime(int t, float x, float y, float size, const sf::Color& color, sf::Text& text);
+  void MakeText(const char* str, float x, float y, float size, const sf::Color& color, const sf::Font& font, sf::Text& text);
   void UpdateHover(Texts from, Texts to, float mouse_x, float mouse_y);
 
+  //Only re-lays out the text when the string or the scale changed since the
+  //last call. Returns true if it did, so callers can redo origins and such.
+  bool SetText(Texts id, const std::string& str, float x, float y, float size, const sf::Color& color=sf::Color::White, bool mono=false);
+  TextBatch* BatchOf(Texts id);
+  const sf::Font& FontOf(Texts id, bool mono) const;
+  void DrawBatch(sf::RenderWindow& window, TextBatch& batch, Texts from, Texts to);
+
 private:
   sf::Text all_text[NUM_TEXTS];
+  std::string all_str[NUM_TEXTS];
+  bool all_dirty[NUM_TEXTS];
   bool all_hover[NUM_TEXTS];
 
-  sf::Sound sound_hover;
-  sf::SoundBuffer buff_hover;
-  sf::Sound sound_click;
-  sf::SoundBuffer buff_click;
-  sf::Sound sound_count;
-  sf::SoundBuffer buff_count;
-  sf::Sound sound_go;
-  sf::SoundBuffer buff_go;
+  TextBatch menu_batch;
+  TextBatch paused_batch;
+  TextBatch controls_batch;
+  TextBatch levels_batch;
+  TextBatch credits_batch;
 
+  AsyncSound sound_hover;
+  AsyncSound sound_click;
+  AsyncSound sound_count;
+  AsyncSound sound_go;
+
+  AsyncAsset<sf::Image> arrow_img;
   sf::Texture arrow_tex;
   sf::Sprite arrow_spr;
 
+  Hud hud;
+
   float draw_scale;
   bool top_level;
+  int last_sound_t;
 
   const sf::Font* font;
   const sf::Font* font_mono;
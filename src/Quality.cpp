@@ -0,0 +1,121 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Quality.h"
+#include "GL3Backend.h"
+#include <fstream>
+
+const QualityPreset all_quality[num_quality] = {
+  //                name      marches  shadow  shadows  specular  aa  buffer
+  QualityPreset("Low",          250,     50,   false,   false,    1,  false),
+  QualityPreset("Medium",       500,    100,   true,    true,     1,  true),
+  QualityPreset("High",        1000,    200,   true,    true,     1,  true),
+  QualityPreset("Ultra",       1000,    200,   true,    true,     2,  false),
+};
+
+int quality_setting = default_quality;
+
+ShaderDefines QualityPreset::GetDefines() const {
+  ShaderDefines defines;
+  defines["ANTIALIASING_SAMPLES"] = std::to_string(aa_samples);
+  defines["MAX_MARCHES"] = std::to_string(max_marches);
+  defines["SHADOW_MAX_MARCHES"] = std::to_string(shadow_marches);
+  defines["SHADOWS_ENABLED"] = (shadows ? "1" : "0");
+  if (!specular) {
+    defines["SPECULAR_HIGHLIGHT"] = "0";
+  }
+  return defines;
+}
+
+void LoadQuality(const std::string& fname) {
+  std::ifstream fin(fname, std::ios::binary);
+  if (!fin) { return; }
+  int q = default_quality;
+  fin.read((char*)&q, sizeof(q));
+  if (fin && q >= 0 && q < num_quality) {
+    quality_setting = q;
+  }
+}
+
+void SaveQuality(const std::string& fname) {
+  std::ofstream fout(fname, std::ios::binary);
+  if (!fout) { return; }
+  fout.write((const char*)&quality_setting, sizeof(quality_setting));
+}
+
+sf::Shader* ShaderCache::Get(const ShaderDefines& defines) {
+  std::string key;
+  for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it) {
+    key += it->first + "=" + it->second + ";";
+  }
+
+  //Failures are remembered too, so they aren't recompiled every time
+  if (failed.count(key) > 0) {
+    return nullptr;
+  }
+  std::unique_ptr<sf::Shader>& shader = shaders[key];
+  if (!shader) {
+    shader.reset(new sf::Shader);
+    if (!LoadFractalShader(*shader, defines)) {
+      shaders.erase(key);
+      failed.insert(key);
+      return nullptr;
+    }
+  }
+  return shader.get();
+}
+
+bool GetQualityShaders(ShaderCache& cache, int quality, QualityShaders& out, const ShaderDefines& extra) {
+  const QualityPreset& preset = all_quality[quality];
+  ShaderDefines defines = preset.GetDefines();
+  for (ShaderDefines::const_iterator it = extra.begin(); it != extra.end(); ++it) {
+    defines[it->first] = it->second;
+  }
+  out.main = cache.Get(defines);
+  out.baked = false;
+
+  //Prepasses are the same shader with the same budgets
+  defines["CONE_PREPASS"] = "1";
+  out.cone = cache.Get(defines);
+  defines.erase("CONE_PREPASS");
+  out.shadow = nullptr;
+  if (preset.shadows && preset.shadow_buffer) {
+    defines["SHADOW_PASS"] = "1";
+    out.shadow = cache.Get(defines);
+    if (out.shadow == nullptr) {
+      return false;
+    }
+  }
+  return out.main != nullptr && out.cone != nullptr;
+}
+
+bool CompileQualityShaders(ShaderCache& cache, QualityShaders out[num_quality]) {
+  for (int i = 0; i < num_quality; ++i) {
+    if (!GetQualityShaders(cache, i, out[i])) {
+      out[i].main = nullptr;
+    }
+  }
+  if (out[quality_setting].main == nullptr) {
+    quality_setting = default_quality;
+  }
+  return out[quality_setting].main != nullptr;
+}
+
+void NextQuality(const QualityShaders shaders[num_quality]) {
+  do {
+    quality_setting = (quality_setting + 1) % num_quality;
+  } while (shaders[quality_setting].main == nullptr);
+}
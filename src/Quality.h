@@ -0,0 +1,82 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "ShaderVariant.h"
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+struct QualityPreset {
+  QualityPreset(const char* n, int marches, int s_marches, bool shad, bool spec, int aa, bool s_buf) :
+    name(n), max_marches(marches), shadow_marches(s_marches), shadows(shad),
+    specular(spec), aa_samples(aa), shadow_buffer(s_buf) {}
+
+  //Defines to compile frag.glsl with for this preset
+  ShaderDefines GetDefines() const;
+
+  const char* name;    //Shown in the pause menu
+  int max_marches;     //Step budget of camera rays
+  int shadow_marches;  //Step budget of shadow buffer rays
+  bool shadows;        //Soft shadows at all
+  bool specular;       //Specular highlights
+  int aa_samples;      //Supersamples per axis, on top of temporal antialiasing
+  bool shadow_buffer;  //Half resolution shadows instead of one march per pixel
+};
+static const int num_quality = 4;
+static const int default_quality = 2;
+extern const QualityPreset all_quality[num_quality];
+extern int quality_setting;
+
+//Read and write the chosen preset, kept next to the high scores
+void LoadQuality(const std::string& fname);
+void SaveQuality(const std::string& fname);
+
+//Compiled fractal shader variants, by define set. Each is compiled once and
+//kept, so switching between variants that were used before is instant.
+class ShaderCache {
+public:
+  //Returns nullptr if the variant doesn't compile
+  sf::Shader* Get(const ShaderDefines& defines);
+
+private:
+  std::map<std::string, std::unique_ptr<sf::Shader>> shaders;
+  std::set<std::string> failed;
+};
+
+//Every shader one preset renders a frame with. Passes the preset doesn't use
+//are nullptr.
+struct QualityShaders {
+  sf::Shader* main;
+  sf::Shader* cone;
+  sf::Shader* shadow;
+  bool baked;         //A level's fractal parameters are compiled in, see BakedShaders
+};
+
+//Finds or compiles the shaders of a preset, false if any of them fail. The
+//extra defines are applied on top of the preset's own.
+bool GetQualityShaders(ShaderCache& cache, int quality, QualityShaders& out,
+                       const ShaderDefines& extra = ShaderDefines());
+
+//Compiles every preset up front so switching in the pause menu is instant.
+//Presets that fail are left with a nullptr main shader. If the chosen one
+//failed quality_setting falls back to the default, false if that failed too.
+bool CompileQualityShaders(ShaderCache& cache, QualityShaders out[num_quality]);
+
+//Steps quality_setting to the next preset that compiled
+void NextQuality(const QualityShaders shaders[num_quality]);
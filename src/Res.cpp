@@ -15,6 +15,152 @@
 * along with this program.If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Res.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+//The mapped pack, never unmapped
+static const char* pack_data = nullptr;
+static const ResPackEntry* pack_entries = nullptr;
+static uint32_t pack_num_entries = 0;
 
 Res::Res(const void* ptr, size_t size)
   : ptr(ptr), size(size) {}
+
+//Directory of the running executable, with a trailing separator
+static std::string GetExeDir(const char* argv0) {
+  std::string path;
+#if defined(_WIN32)
+  char buf[MAX_PATH];
+  const DWORD len = GetModuleFileNameA(nullptr, buf, MAX_PATH);
+  if (len > 0 && len < MAX_PATH) { path.assign(buf, len); }
+#elif defined(__APPLE__)
+  char buf[4096];
+  uint32_t len = sizeof(buf);
+  if (_NSGetExecutablePath(buf, &len) == 0) { path = buf; }
+#else
+  char buf[4096];
+  const ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf));
+  if (len > 0 && len < (ssize_t)sizeof(buf)) { path.assign(buf, len); }
+#endif
+  if (path.empty() && argv0) {
+    path = argv0;
+  }
+  const size_t slash = path.find_last_of("/\\");
+  return (slash == std::string::npos ? std::string() : path.substr(0, slash + 1));
+}
+
+static const void* MapFile(const std::string& fname, size_t& size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) { return nullptr; }
+  LARGE_INTEGER file_size;
+  HANDLE mapping = nullptr;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  }
+  CloseHandle(file);
+  if (!mapping) { return nullptr; }
+  const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  size = (size_t)file_size.QuadPart;
+  return data;
+#else
+  const int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) { return nullptr; }
+  struct stat info;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) { return nullptr; }
+  size = (size_t)info.st_size;
+  return data;
+#endif
+}
+
+static void UnmapFile(const void* data, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap(const_cast<void*>(data), size);
+#endif
+}
+
+static bool EntryLess(const ResPackEntry& a, const ResPackEntry& b) {
+  return std::strncmp(a.name, b.name, res_name_len) < 0;
+}
+
+bool OpenResPack(const char* argv0) {
+  if (pack_data) { return true; }
+  size_t size = 0;
+  const char* data = (const char*)MapFile(GetExeDir(argv0) + res_pack, size);
+  if (!data) { return false; }
+
+  //Check the whole index up front so lookups can trust it
+  const ResPackHeader* header = (const ResPackHeader*)data;
+  bool valid = (size >= sizeof(ResPackHeader) && std::memcmp(header->magic, res_pack_magic, sizeof(res_pack_magic)) == 0);
+  const ResPackEntry* entries = (const ResPackEntry*)(data + sizeof(ResPackHeader));
+  if (valid) {
+    valid = (header->num_entries <= (size - sizeof(ResPackHeader)) / sizeof(ResPackEntry));
+  }
+  for (uint32_t i = 0; valid && i < header->num_entries; ++i) {
+    valid = (entries[i].offset <= size && entries[i].size <= size - entries[i].offset &&
+             entries[i].name[res_name_len - 1] == '\0' &&
+             (i == 0 || EntryLess(entries[i - 1], entries[i])));
+  }
+  if (!valid) {
+    UnmapFile(data, size);
+    return false;
+  }
+
+  pack_data = data;
+  pack_entries = entries;
+  pack_num_entries = header->num_entries;
+  return true;
+}
+
+Res GetRes(const char* name) {
+  if (!pack_data || std::strlen(name) >= res_name_len) {
+    return Res(nullptr, 0);
+  }
+  ResPackEntry key;
+  std::memset(key.name, 0, res_name_len);
+  std::strcpy(key.name, name);
+  const ResPackEntry* end = pack_entries + pack_num_entries;
+  const ResPackEntry* entry = std::lower_bound(pack_entries, end, key, EntryLess);
+  if (entry == end || std::strncmp(entry->name, name, res_name_len) != 0) {
+    return Res(nullptr, 0);
+  }
+  return Res(pack_data + entry->offset, (size_t)entry->size);
+}
+
+bool ReadRes(const char* name, std::string& out) {
+  const Res res = GetRes(name);
+  if (res.ptr) {
+    out.assign((const char*)res.ptr, res.size);
+    return true;
+  }
+  std::ifstream fin(name, std::ios::binary);
+  if (!fin) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  out = ss.str();
+  return true;
+}
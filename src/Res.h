@@ -15,10 +15,18 @@
 * along with this program.If not, see <http://www.gnu.org/licenses/>.
 */
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+//Names of the assets in the pack, and their loose files relative to the
+//working directory when there is no pack
+
 static const char vert_glsl[] = "assets/vert.glsl";
+static const char vert3_glsl[] = "assets/vert3.glsl";
 static const char frag_glsl[] = "assets/frag.glsl";
+static const char taa_glsl[] = "assets/taa.glsl";
+static const char upscale_glsl[] = "assets/upscale.glsl";
 static const char Orbitron_Bold_ttf[] = "assets/Orbitron-Bold.ttf";
 static const char Inconsolata_Bold_ttf[] = "assets/Inconsolata-Bold.ttf";
 static const char menu_ogg[] = "assets/menu.ogg";
@@ -35,3 +43,43 @@ static const char bounce1_wav[] = "assets/bounce1.wav";
 static const char bounce2_wav[] = "assets/bounce2.wav";
 static const char bounce3_wav[] = "assets/bounce3.wav";
 static const char shatter_wav[] = "assets/shatter.wav";
+
+//All of the above in one file next to the executable, built by the
+//asset_pack target. It is a header, an index sorted by name and the blobs,
+//each starting on a res_pack_align boundary.
+static const char res_pack[] = "assets.pack";
+static const char res_pack_magic[8] = { 'M', 'M', 'P', 'A', 'C', 'K', '1', '\0' };
+static const size_t res_pack_align = 64;
+static const size_t res_name_len = 48;
+
+struct ResPackHeader {
+  char     magic[8];
+  uint32_t num_entries;
+  uint32_t reserved;
+};
+
+struct ResPackEntry {
+  char     name[res_name_len]; //Zero padded
+  uint64_t offset;             //From the start of the file
+  uint64_t size;
+};
+
+//Bytes of an asset in the mapped pack, valid until the program exits
+class Res {
+public:
+  Res(const void* ptr, size_t size);
+
+  const void* ptr;
+  size_t size;
+};
+
+//Memory maps the pack next to the executable, argv0 is only used where the
+//executable's path can't be asked for. Returns false if there is no pack,
+//and assets are then read from their loose files.
+bool OpenResPack(const char* argv0 = nullptr);
+
+//ptr is null if the asset isn't packed
+Res GetRes(const char* name);
+
+//Copies out the asset, from the pack or its loose file
+bool ReadRes(const char* name, std::string& out);
@@ -15,19 +15,14 @@
 * along with this program.If not, see <http://www.gnu.org/licenses/>.
 */
 #include "Scene.h"
+#include "FractalBatch.h"
 #include "Scores.h"
 #include "Res.h"
 #include <iostream>
 
 static const float pi = 3.14159265359f;
-static const float ground_force = 0.008f;
-static const float air_force = 0.004f;
-static const float ground_friction = 0.99f;
-static const float air_friction = 0.995f;
 static const float orbit_speed = 0.005f;
 static const int max_marches = 10;
-static const int num_phys_steps = 6;
-static const float marble_bounce = 1.2f; //Range 1.0 to 2.0
 static const float orbit_smooth = 0.995f;
 static const float zoom_smooth = 0.85f;
 static const float look_smooth = 0.75f;
@@ -36,9 +31,6 @@ static const int frame_orbit = 600;
 static const int frame_deorbit = 800;
 static const int frame_countdown = frame_deorbit + 3*60;
 static const float default_zoom = 15.0f;
-static const int fractal_iters = 16;
-static const float gravity = 0.005f;
-static const float ground_ratio = 1.15f;
 static const int mus_switch_lev = 9;
 
 static void ModPi(float& a, float b) {
@@ -53,16 +45,15 @@ Scene::Scene(sf::Music* m1, sf::Music* m2) :
   intro_needs_snap(true),
   play_single(false),
   exposure(1.0f),
+  render_snap(true),
   cam_mat(Eigen::Matrix4f::Identity()),
   cam_look_x(0.0f),
   cam_look_y(0.0f),
   cam_dist(default_zoom),
   cam_pos(0.0f, 0.0f, 0.0f),
   cam_mode(CamMode::INTRO),
-  marble_rad(1.0f),
-  marble_pos(0.0f, 0.0f, 0.0f),
-  marble_vel(0.0f, 0.0f, 0.0f),
   marble_mat(Eigen::Matrix3f::Identity()),
+  phys_mode(MarbleSim::PHYS_AUTO),
   flag_pos(0.0f, 0.0f, 0.0f),
   timer(0),
   music_1(m1),
@@ -70,31 +61,32 @@ Scene::Scene(sf::Music* m1, sf::Music* m2) :
   cur_level(0) {
   frac_params.setOnes();
   frac_params_smooth.setOnes();
+  kernel.Build(frac_params_smooth);
   SnapCamera();
-  buff_goal.loadFromFile(goal_wav);
-  sound_goal.setBuffer(buff_goal);
-  buff_bounce1.loadFromFile(bounce1_wav);
-  sound_bounce1.setBuffer(buff_bounce1);
-  buff_bounce2.loadFromFile(bounce2_wav);
-  sound_bounce2.setBuffer(buff_bounce2);
-  buff_bounce3.loadFromFile(bounce3_wav);
-  sound_bounce3.setBuffer(buff_bounce3);
-  buff_shatter.loadFromFile(shatter_wav);
-  sound_shatter.setBuffer(buff_shatter);
+  if (music_1 && music_2) {
+    sounds.reset(new Sounds());
+    sounds->goal.Load(goal_wav);
+    sounds->bounce1.Load(bounce1_wav);
+    sounds->bounce2.Load(bounce2_wav);
+    sounds->bounce3.Load(bounce3_wav);
+    sounds->shatter.Load(shatter_wav);
+  }
 }
 
 void Scene::LoadLevel(int level) {
   cur_level = level;
-  marble_pos = all_levels[level].start_pos;
-  marble_rad = all_levels[level].marble_rad;
+  marble.pos = all_levels[level].start_pos;
+  marble.rad = all_levels[level].marble_rad;
   flag_pos = all_levels[level].end_pos;
   cam_look_x = all_levels[level].start_look_x;
+  render_snap = true;
 }
 
 void Scene::SetMarble(float x, float y, float z, float r) {
-  marble_rad = r;
-  marble_pos = Eigen::Vector3f(x, y, z);
-  marble_vel.setZero();
+  marble.rad = r;
+  marble.pos = Eigen::Vector3f(x, y, z);
+  marble.vel.setZero();
+  render_snap = true;
 }
 
 void Scene::SetFlag(float x, float y, float z) {
@@ -125,12 +117,12 @@ int Scene::GetCountdownTime() const {
 }
 
 sf::Vector3f Scene::GetGoalDirection() const {
-  Eigen::Vector3f goal_delta = marble_mat.transpose() * (flag_pos - marble_pos);
+  Eigen::Vector3f goal_delta = marble_mat.transpose() * (flag_pos - marble.pos);
   goal_delta.y() = 0.0f;
   const float goal_dir = std::atan2(-goal_delta.z(), goal_delta.x());
   const float a = cam_look_x - goal_dir;
   const float b = std::abs(cam_look_y * 2.0f / pi);
-  const float d = goal_delta.norm() / marble_rad;
+  const float d = goal_delta.norm() / marble.rad;
   return sf::Vector3f(a, b, d);
 }
 
@@ -139,8 +131,10 @@ sf::Music& Scene::GetCurMusic() const {
 }
 
 void Scene::StopAllMusic() {
-  music_1->stop();
-  music_2->stop();
+  if (sounds) {
+    music_1->stop();
+    music_2->stop();
+  }
 }
 
 bool Scene::IsHighScore() const {
@@ -168,7 +162,7 @@ void Scene::StartNextLevel() {
     cur_level += 1;
     HideObjects();
     SetMode(ORBIT);
-    if (cur_level == mus_switch_lev) {
+    if (cur_level == mus_switch_lev && sounds) {
       music_1->stop();
       music_2->play();
     }
@@ -188,9 +182,10 @@ void Scene::ResetLevel() {
     timer = frame_deorbit;
     frac_params = all_levels[cur_level].params;
     frac_params_smooth = frac_params;
-    marble_pos = all_levels[cur_level].start_pos;
-    marble_vel.setZero();
-    marble_rad = all_levels[cur_level].marble_rad;
+    kernel.Build(frac_params_smooth);
+    marble.pos = all_levels[cur_level].start_pos;
+    marble.vel.setZero();
+    marble.rad = all_levels[cur_level].marble_rad;
     marble_mat.setIdentity();
     flag_pos = all_levels[cur_level].end_pos;
     cam_look_x = all_levels[cur_level].start_look_x;
@@ -200,6 +195,7 @@ void Scene::ResetLevel() {
     cam_dist_smooth = cam_dist;
     cam_look_y = -0.3f;
     cam_look_y_smooth = cam_look_y;
+    render_snap = true;
   }
 }
 
@@ -234,65 +230,44 @@ void Scene::UpdateMarble(float dx, float dy) {
     dy /= mag;
   }
 
-  //Apply all physics (gravity and collision)
-  bool onGround = false;
-  float max_delta_v = 0.0f;
-  for (int i = 0; i < num_phys_steps; ++i) {
-    const float force = marble_rad * gravity / num_phys_steps;
-    if (all_levels[cur_level].planet) {
-      marble_vel -= marble_pos.normalized() * force;
-    } else {
-      marble_vel.y() -= force;
-    }
-    marble_pos += marble_vel / num_phys_steps;
-    onGround |= MarbleCollision(max_delta_v);
-  }
-
-  //Play bounce sound if needed
-  if (max_delta_v > 0.01f) {
-    sound_bounce1.play();
-  } else if (max_delta_v > 0.005f) {
-    sound_bounce2.play();
-  } else if (max_delta_v > 0.002f) {
-    sound_bounce3.setVolume(100.0f * (max_delta_v / 0.005f));
-    sound_bounce3.play();
-  }
-
-  //Add force from keyboard
-  const float f = marble_rad * (onGround ? ground_force : air_force);
+  //Apply all physics (gravity, collision and the input force)
   const float cs = std::cos(cam_look_x);
   const float sn = std::sin(cam_look_x);
   Eigen::Vector3f v(dx*cs - dy*sn, 0.0f, -dy*cs - dx*sn);
-  marble_vel += (marble_mat * v) * f;
+  const MarbleTick tick = MarbleSim::Tick(kernel, all_levels[cur_level], phys_mode, marble, marble_mat * v);
+  if (tick.crushed) {
+    if (sounds) { sounds->shatter.play(); }
+    render_snap = true;
+  }
 
-  //Apply friction
-  marble_vel *= (onGround ? ground_friction : air_friction);
+  //Play bounce sound if needed
+  const float max_delta_v = tick.max_delta_v;
+  if (sounds) {
+    if (max_delta_v > 0.01f) {
+      sounds->bounce1.play();
+    } else if (max_delta_v > 0.005f) {
+      sounds->bounce2.play();
+    } else if (max_delta_v > 0.002f) {
+      sounds->bounce3.setVolume(100.0f * (max_delta_v / 0.005f));
+      sounds->bounce3.play();
+    }
+  }
 
   //Update animated fractals
-  frac_params[1] = all_levels[cur_level].params[1] + all_levels[cur_level].anim_1 * std::sin(timer * 0.015f);
-  frac_params[2] = all_levels[cur_level].params[2] + all_levels[cur_level].anim_2 * std::sin(timer * 0.015f);
-  frac_params[4] = all_levels[cur_level].params[4] + all_levels[cur_level].anim_3 * std::sin(timer * 0.015f);
+  MarbleSim::Animate(all_levels[cur_level], timer, frac_params);
   frac_params_smooth = frac_params;
+  kernel.Build(frac_params_smooth);
 
   //Check if marble has hit flag post
-  if (cam_mode != GOAL) {
-    const bool flag_y_match = all_levels[cur_level].planet ?
-      marble_pos.y() <= flag_pos.y() && marble_pos.y() >= flag_pos.y() - 7*marble_rad :
-      marble_pos.y() >= flag_pos.y() && marble_pos.y() <= flag_pos.y() + 7*marble_rad;
-    if (flag_y_match) {
-      const float fx = marble_pos.x() - flag_pos.x();
-      const float fz = marble_pos.z() - flag_pos.z();
-      if (fx*fx + fz*fz < 6 * marble_rad*marble_rad) {
-        final_time = timer;
-        high_scores.Update(cur_level, final_time);
-        SetMode(GOAL);
-        sound_goal.play();
-      }
-    }
+  if (cam_mode != GOAL && MarbleSim::HitFlag(all_levels[cur_level], flag_pos, marble)) {
+    final_time = timer;
+    high_scores.Update(cur_level, final_time);
+    SetMode(GOAL);
+    if (sounds) { sounds->goal.play(); }
   }
 
   //Check if marble passed the death barrier
-  if (marble_pos.y() < all_levels[cur_level].kill_y) {
+  if (marble.pos.y() < all_levels[cur_level].kill_y) {
     ResetLevel();
   }
 }
@@ -335,6 +310,7 @@ void Scene::UpdateIntro(bool ssaver) {
   frac_params[7] = -0.1f;
   frac_params[8] = -0.6f;
   frac_params_smooth = frac_params;
+  kernel.Build(frac_params_smooth);
 
   //Make sure marble and flag are hidden
   HideObjects();
@@ -377,11 +353,12 @@ void Scene::UpdateOrbit() {
   ModPi(frac_params[1], all_levels[cur_level].params[1]);
   ModPi(frac_params[2], all_levels[cur_level].params[2]);
   frac_params_smooth = frac_params * (1.0f - a) + all_levels[cur_level].params * a;
+  kernel.Build(frac_params_smooth);
 
   //When done transitioning display the marble and flag
   if (timer >= frame_transition) {
-    marble_pos = all_levels[cur_level].start_pos;
-    marble_rad = all_levels[cur_level].marble_rad;
+    marble.pos = all_levels[cur_level].start_pos;
+    marble.rad = all_levels[cur_level].marble_rad;
     flag_pos = all_levels[cur_level].end_pos;
   }
 
@@ -426,8 +403,8 @@ void Scene::UpdateDeOrbit() {
   MakeCameraRotation();
 
   //Update the camera position
-  Eigen::Vector3f marble_cam_pos = marble_pos + cam_mat.block<3, 3>(0, 0) * Eigen::Vector3f(0.0f, 0.0f, marble_rad * cam_dist_smooth);
-  marble_cam_pos += Eigen::Vector3f(0.0f, marble_rad * cam_dist_smooth * 0.1f, 0.0f);
+  Eigen::Vector3f marble_cam_pos = marble.pos + cam_mat.block<3, 3>(0, 0) * Eigen::Vector3f(0.0f, 0.0f, marble.rad * cam_dist_smooth);
+  marble_cam_pos += Eigen::Vector3f(0.0f, marble.rad * cam_dist_smooth * 0.1f, 0.0f);
   cam_pos_smooth = cam_pos*(1 - b) + marble_cam_pos*b;
   cam_mat.block<3, 1>(0, 3) = cam_pos_smooth;
 
@@ -461,7 +438,7 @@ void Scene::UpdateNormal(float dx, float dy, float dz) {
 
   //Setup rotation matrix for planets
   if (all_levels[cur_level].planet) {
-    marble_mat.col(1) = marble_pos.normalized();
+    marble_mat.col(1) = marble.pos.normalized();
     marble_mat.col(2) = -marble_mat.col(1).cross(marble_mat.col(0)).normalized();
     marble_mat.col(0) = -marble_mat.col(2).cross(marble_mat.col(1)).normalized();
   } else {
@@ -470,8 +447,8 @@ void Scene::UpdateNormal(float dx, float dy, float dz) {
 
   //Update the camera matrix
   MakeCameraRotation();
-  cam_pos = marble_pos + cam_mat.block<3, 3>(0, 0) * Eigen::Vector3f(0.0f, 0.0f, marble_rad * cam_dist_smooth);
-  cam_pos += marble_mat.col(1) * (marble_rad * cam_dist_smooth * 0.1f);
+  cam_pos = marble.pos + cam_mat.block<3, 3>(0, 0) * Eigen::Vector3f(0.0f, 0.0f, marble.rad * cam_dist_smooth);
+  cam_pos += marble_mat.col(1) * (marble.rad * cam_dist_smooth * 0.1f);
   cam_pos_smooth = cam_pos;
   cam_mat.block<3, 1>(0, 3) = cam_pos_smooth;
 
@@ -486,7 +463,7 @@ void Scene::UpdateGoal() {
   timer += 1;
 
   //Get marble location and rotational parameters
-  const float flag_dist = marble_rad * 6.5f;
+  const float flag_dist = marble.rad * 6.5f;
   const Eigen::Vector3f orbit_pt = flag_pos + marble_mat * Eigen::Vector3f(0.0f, flag_dist, 0.0f);
   const Eigen::Vector3f perp_vec = Eigen::Vector3f(std::sin(t), 0.0f, std::cos(t));
   cam_pos = orbit_pt + marble_mat * perp_vec * (flag_dist * 3.5f);
@@ -506,10 +483,10 @@ void Scene::UpdateGoal() {
   cam_mat.block<3, 1>(0, 3) = cam_pos_smooth;
 
   //Animate marble
-  marble_vel += (orbit_pt - marble_pos) * 0.005f;
-  marble_pos += marble_vel;
-  if (marble_vel.norm() > marble_rad*0.02f) {
-    marble_vel *= 0.95f;
+  marble.vel += (orbit_pt - marble.pos) * 0.005f;
+  marble.pos += marble.vel;
+  if (marble.vel.norm() > marble.rad*0.02f) {
+    marble.vel *= 0.95f;
   }
 
   if (timer > 300 && cam_mode != FINAL) {
@@ -529,184 +506,100 @@ void Scene::SnapCamera() {
   cam_look_y_smooth = cam_look_y;
   cam_dist_smooth = cam_dist;
   cam_pos_smooth = cam_pos;
+  render_snap = true;
 }
 
 void Scene::HideObjects() {
-  marble_pos = Eigen::Vector3f(999.0f, 999.0f, 999.0f);
+  marble.pos = Eigen::Vector3f(999.0f, 999.0f, 999.0f);
   flag_pos = Eigen::Vector3f(999.0f, 999.0f, 999.0f);
-  marble_vel.setZero();
+  marble.vel.setZero();
 }
 
-void Scene::Write(sf::Shader& shader) const {
-  shader.setUniform("iMat", sf::Glsl::Mat4(cam_mat.data()));
-
-  shader.setUniform("iMarblePos", sf::Glsl::Vec3(marble_pos.x(), marble_pos.y(), marble_pos.z()));
-  shader.setUniform("iMarbleRad", marble_rad);
+void Scene::BeginTick() {
+  GetUniforms(prev_uniforms);
+  render_snap = false;
+}
 
-  shader.setUniform("iFlagScale", all_levels[cur_level].planet ? -marble_rad : marble_rad);
-  shader.setUniform("iFlagPos", sf::Glsl::Vec3(flag_pos.x(), flag_pos.y(), flag_pos.z()));
+void Scene::GetUniforms(SceneUniforms& u) const {
+  u.cam_mat = cam_mat;
+  u.marble_pos = marble.pos;
+  u.marble_rad = marble.rad;
+  u.flag_pos = flag_pos;
+  u.flag_scale = all_levels[cur_level].planet ? -marble.rad : marble.rad;
+  u.frac_params = frac_params_smooth;
+  u.exposure = exposure;
+}
 
-  shader.setUniform("iFracScale", frac_params_smooth[0]);
-  shader.setUniform("iFracAng1", frac_params_smooth[1]);
-  shader.setUniform("iFracAng2", frac_params_smooth[2]);
-  shader.setUniform("iFracShift", sf::Glsl::Vec3(frac_params_smooth[3], frac_params_smooth[4], frac_params_smooth[5]));
-  shader.setUniform("iFracCol", sf::Glsl::Vec3(frac_params_smooth[6], frac_params_smooth[7], frac_params_smooth[8]));
+void Scene::GetFrameUniforms(SceneUniforms& u, float alpha) const {
+  //Blend between the last two physics ticks unless something teleported
+  GetUniforms(u);
+  if (!render_snap && alpha < 1.0f) {
+    u = SceneUniforms::Lerp(prev_uniforms, u, alpha);
+  }
+}
 
-  shader.setUniform("iExposure", exposure);
+void Scene::GetSnapshot(SceneSnapshot& s) const {
+  s.prev = prev_uniforms;
+  GetUniforms(s.cur);
+  s.snap = render_snap;
+  s.cam_mode = cam_mode;
+  s.level = cur_level;
+  s.marble_pos = marble.pos;
+  s.goal_direction = GetGoalDirection();
+  s.countdown_time = GetCountdownTime();
+  s.high_score = IsHighScore();
 }
 
-//Hard-coded to match the fractal
-float Scene::DE(const Eigen::Vector3f& pt) const {
-  //Easier to work with names
-  const float frac_scale = frac_params_smooth[0];
-  const float frac_angle1 = frac_params_smooth[1];
-  const float frac_angle2 = frac_params_smooth[2];
-  const Eigen::Vector3f frac_shift = frac_params_smooth.segment<3>(3);
-  const Eigen::Vector3f frac_color = frac_params_smooth.segment<3>(6);
-
-  Eigen::Vector4f p;
-  p << pt, 1.0f;
-  for (int i = 0; i < fractal_iters; ++i) {
-    //absFold
-    p.segment<3>(0) = p.segment<3>(0).cwiseAbs();
-    //rotZ
-    const float rotz_c = std::cos(frac_angle1);
-    const float rotz_s = std::sin(frac_angle1);
-    const float rotz_x = rotz_c*p.x() + rotz_s*p.y();
-    const float rotz_y = rotz_c*p.y() - rotz_s*p.x();
-    p.x() = rotz_x; p.y() = rotz_y;
-    //mengerFold
-    float a = std::min(p.x() - p.y(), 0.0f);
-    p.x() -= a; p.y() += a;
-    a = std::min(p.x() - p.z(), 0.0f);
-    p.x() -= a; p.z() += a;
-    a = std::min(p.y() - p.z(), 0.0f);
-    p.y() -= a; p.z() += a;
-    //rotX
-    const float rotx_c = std::cos(frac_angle2);
-    const float rotx_s = std::sin(frac_angle2);
-    const float rotx_y = rotx_c*p.y() + rotx_s*p.z();
-    const float rotx_z = rotx_c*p.z() - rotx_s*p.y();
-    p.y() = rotx_y; p.z() = rotx_z;
-    //scaleTrans
-    p *= frac_scale;
-    p.segment<3>(0) += frac_shift;
+void SceneSnapshot::GetFrameUniforms(SceneUniforms& u, float alpha) const {
+  u = cur;
+  if (!snap && alpha < 1.0f) {
+    u = SceneUniforms::Lerp(prev, cur, alpha);
   }
-  const Eigen::Vector3f a = p.segment<3>(0).cwiseAbs() - Eigen::Vector3f(6.0f, 6.0f, 6.0f);
-  return (std::min(std::max(std::max(a.x(), a.y()), a.z()), 0.0f) + a.cwiseMax(0.0f).norm()) / p.w();
 }
 
-//Hard-coded to match the fractal
-Eigen::Vector3f Scene::NP(const Eigen::Vector3f& pt) const {
-  //Easier to work with names
-  const float frac_scale = frac_params_smooth[0];
-  const float frac_angle1 = frac_params_smooth[1];
-  const float frac_angle2 = frac_params_smooth[2];
-  const Eigen::Vector3f frac_shift = frac_params_smooth.segment<3>(3);
-  const Eigen::Vector3f frac_color = frac_params_smooth.segment<3>(6);
-
-  static std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f>> p_hist;
-  p_hist.clear();
-  Eigen::Vector4f p;
-  p << pt, 1.0f;
-  //Fold the point, keeping history
-  for (int i = 0; i < fractal_iters; ++i) {
-    //absFold
-    p_hist.push_back(p);
-    p.segment<3>(0) = p.segment<3>(0).cwiseAbs();
-    //rotZ
-    const float rotz_c = std::cos(frac_angle1);
-    const float rotz_s = std::sin(frac_angle1);
-    const float rotz_x = rotz_c*p.x() + rotz_s*p.y();
-    const float rotz_y = rotz_c*p.y() - rotz_s*p.x();
-    p.x() = rotz_x; p.y() = rotz_y;
-    //mengerFold
-    p_hist.push_back(p);
-    float a = std::min(p.x() - p.y(), 0.0f);
-    p.x() -= a; p.y() += a;
-    a = std::min(p.x() - p.z(), 0.0f);
-    p.x() -= a; p.z() += a;
-    a = std::min(p.y() - p.z(), 0.0f);
-    p.y() -= a; p.z() += a;
-    //rotX
-    const float rotx_c = std::cos(frac_angle2);
-    const float rotx_s = std::sin(frac_angle2);
-    const float rotx_y = rotx_c*p.y() + rotx_s*p.z();
-    const float rotx_z = rotx_c*p.z() - rotx_s*p.y();
-    p.y() = rotx_y; p.z() = rotx_z;
-    //scaleTrans
-    p *= frac_scale;
-    p.segment<3>(0) += frac_shift;
-  }
-  //Get the nearest point
-  Eigen::Vector3f n = p.segment<3>(0).cwiseMax(-6.0f).cwiseMin(6.0f);
-  //Then unfold the nearest point (reverse order)
-  for (int i = 0; i < fractal_iters; ++i) {
-    //scaleTrans
-    n.segment<3>(0) -= frac_shift;
-    n /= frac_scale;
-    //rotX
-    const float rotx_c = std::cos(-frac_angle2);
-    const float rotx_s = std::sin(-frac_angle2);
-    const float rotx_y = rotx_c*n.y() + rotx_s*n.z();
-    const float rotx_z = rotx_c*n.z() - rotx_s*n.y();
-    n.y() = rotx_y; n.z() = rotx_z;
-    //mengerUnfold
-    p = p_hist.back(); p_hist.pop_back();
-    const float mx = std::max(p[0], p[1]);
-    if (std::min(p[0], p[1]) < std::min(mx, p[2])) {
-      std::swap(n[1], n[2]);
-    }
-    if (mx < p[2]) {
-      std::swap(n[0], n[2]);
-    }
-    if (p[0] < p[1]) {
-      std::swap(n[0], n[1]);
-    }
-    //rotZ
-    const float rotz_c = std::cos(-frac_angle1);
-    const float rotz_s = std::sin(-frac_angle1);
-    const float rotz_x = rotz_c*n.x() + rotz_s*n.y();
-    const float rotz_y = rotz_c*n.y() - rotz_s*n.x();
-    n.x() = rotz_x; n.y() = rotz_y;
-    //absUnfold
-    p = p_hist.back(); p_hist.pop_back();
-    if (p[0] < 0.0f) {
-      n[0] = -n[0];
-    }
-    if (p[1] < 0.0f) {
-      n[1] = -n[1];
-    }
-    if (p[2] < 0.0f) {
-      n[2] = -n[2];
-    }
-  }
-  return n;
+void Scene::Write(sf::Shader& shader, float alpha) const {
+  SceneUniforms u;
+  GetFrameUniforms(u, alpha);
+  Write(shader, u);
 }
 
-bool Scene::MarbleCollision(float& delta_v) {
-  //Check if the distance estimate indicates a collision
-  const float de = DE(marble_pos);
-  if (de >= marble_rad) {
-    return de < marble_rad * ground_ratio;
+void Scene::Write(sf::Shader& shader, const SceneUniforms& u, int uniforms) {
+  //Every pass marches the same scene
+  shader.setUniform("iMat", sf::Glsl::Mat4(u.cam_mat.data()));
+
+  shader.setUniform("iMarblePos", sf::Glsl::Vec3(u.marble_pos.x(), u.marble_pos.y(), u.marble_pos.z()));
+  shader.setUniform("iMarbleRad", u.marble_rad);
+
+  shader.setUniform("iFlagScale", u.flag_scale);
+  shader.setUniform("iFlagPos", sf::Glsl::Vec3(u.flag_pos.x(), u.flag_pos.y(), u.flag_pos.z()));
+
+  if (uniforms & UNIFORMS_FRACTAL) {
+    shader.setUniform("iFracScale", u.frac_params[0]);
+    shader.setUniform("iFracAng1", u.frac_params[1]);
+    shader.setUniform("iFracAng2", u.frac_params[2]);
+    shader.setUniform("iFracShift", sf::Glsl::Vec3(u.frac_params[3], u.frac_params[4], u.frac_params[5]));
+    if (uniforms & UNIFORMS_SHADING) {
+      shader.setUniform("iFracCol", sf::Glsl::Vec3(u.frac_params[6], u.frac_params[7], u.frac_params[8]));
+    }
   }
-  
-  //Check if the marble has been crushed by the fractal
-  if (de < marble_rad * 0.001f) {
-    sound_shatter.play();
-    marble_pos.y() = -9999.0f;
-    return false;
+
+  if (uniforms & UNIFORMS_SHADING) {
+    shader.setUniform("iExposure", u.exposure);
   }
+}
+
+float Scene::DE(const Eigen::Vector3f& pt) const {
+  return kernel.DE(pt);
+}
 
-  //Find the nearest point and compute offset
-  const Eigen::Vector3f np = NP(marble_pos);
-  const Eigen::Vector3f d = np - marble_pos;
-  const Eigen::Vector3f dn = d.normalized();
-
-  //Apply the offset to the marble's position and velocity
-  const float dv = marble_vel.dot(dn);
-  delta_v = std::max(delta_v, dv);
-  marble_pos -= dn * marble_rad - d;
-  marble_vel -= dn * (dv * marble_bounce);
-  return true;
+//Same as DE, but for many points at once using SIMD
+void Scene::DEBatch(const float* xs, const float* ys, const float* zs, float* out, size_t n) const {
+  FractalDEBatch(frac_params_smooth, fractal_iters, xs, ys, zs, out, n);
+}
+
+Eigen::Vector3f Scene::NP(const Eigen::Vector3f& pt) const {
+  //The fold history is a fixed size buffer on the stack, so this is reentrant
+  FractalKernel<fractal_iters>::Folded folded;
+  kernel.Fold(pt, folded);
+  return kernel.NP(folded);
 }
@@ -16,9 +16,17 @@
 */
 #pragma once
 #include "Level.h"
+#include "FractalKernel.h"
+#include "MarbleSim.h"
+#include "SceneUniforms.h"
+#include "AssetLoader.h"
 #include <SFML/Audio.hpp>
 #include <SFML/Graphics.hpp>
 #include <Eigen/Dense>
+#include <chrono>
+#include <memory>
+
+struct SceneSnapshot;
 
 class Scene {
 public:
@@ -32,15 +40,31 @@ public:
     FINAL,
   };
 
-  Scene(sf::Music* m1, sf::Music* m2);
+  //Uniforms a fractal shader variant reads. SFML complains about every uniform
+  //that is set but was compiled out.
+  enum UniformSet {
+    UNIFORMS_FRACTAL = 1, //Fractal parameters, unless the shader was baked
+    UNIFORMS_SHADING = 2, //Colors and exposure, only the main pass shades
+    UNIFORMS_ALL = 3,
+  };
+
+  //Without music the scene is silent and never opens the audio device, so
+  //GetCurMusic must not be called
+  Scene(sf::Music* m1=nullptr, sf::Music* m2=nullptr);
 
   void LoadLevel(int level);
   void SetMarble(float x, float y, float z, float r);
   void SetFlag(float x, float y, float z);
   void SetMode(CamMode mode);
   void SetExposure(float e) { exposure = e; }
+  void SetPhysMode(MarbleSim::PhysMode mode) { phys_mode = mode; }
 
-  const Eigen::Vector3f& GetMarble() const { return marble_pos; };
+  //Marble collision checks that evaluated the fractal, and those skipped in free space
+  unsigned long GetDEEvals() const { return marble.de_evals; }
+  unsigned long GetDESkips() const { return marble.de_skips; }
+  void ResetDEStats() { marble.de_evals = 0; marble.de_skips = 0; }
+
+  const Eigen::Vector3f& GetMarble() const { return marble.pos; };
   float GetCamLook() const { return cam_look_x_smooth; }
   CamMode GetMode() const { return cam_mode; }
   int GetLevel() const { return cur_level; }
@@ -63,11 +87,18 @@ public:
   void SnapCamera();
   void HideObjects();
 
-  void Write(sf::Shader& shader) const;
+  //Call before every fixed physics tick, Write then blends from that state
+  void BeginTick();
+  void GetUniforms(SceneUniforms& u) const;
+  void GetFrameUniforms(SceneUniforms& u, float alpha=1.0f) const;
+  void GetSnapshot(SceneSnapshot& s) const;
+  void Write(sf::Shader& shader, float alpha=1.0f) const;
+  static void Write(sf::Shader& shader, const SceneUniforms& u, int uniforms=UNIFORMS_ALL);
 
+  //Fractal queries only read the scene, so they are safe to run from many threads
   float DE(const Eigen::Vector3f& pt) const;
+  void DEBatch(const float* xs, const float* ys, const float* zs, float* out, size_t n) const;
   Eigen::Vector3f NP(const Eigen::Vector3f& pt) const;
-  bool MarbleCollision(float& delta_v);
 
 protected:
   void UpdateIntro(bool ssaver);
@@ -94,31 +125,52 @@ private:
   float           cam_dist_smooth;
   Eigen::Vector3f cam_pos_smooth;
 
-  float           marble_rad;
-  Eigen::Vector3f marble_pos;
-  Eigen::Vector3f marble_vel;
+  MarbleState     marble;
   Eigen::Matrix3f marble_mat;
+  MarbleSim::PhysMode phys_mode;
 
   Eigen::Vector3f flag_pos;
 
   FractalParams   frac_params;
   FractalParams   frac_params_smooth;
+  FractalKernel<fractal_iters> kernel;
 
   int             timer;
   int             final_time;
   float           exposure;
 
-  sf::Sound sound_goal;
-  sf::SoundBuffer buff_goal;
-  sf::Sound sound_bounce1;
-  sf::SoundBuffer buff_bounce1;
-  sf::Sound sound_bounce2;
-  sf::SoundBuffer buff_bounce2;
-  sf::Sound sound_bounce3;
-  sf::SoundBuffer buff_bounce3;
-  sf::Sound sound_shatter;
-  sf::SoundBuffer buff_shatter;
+  SceneUniforms   prev_uniforms;
+  bool            render_snap;
+
+  struct Sounds {
+    AsyncSound goal;
+    AsyncSound bounce1;
+    AsyncSound bounce2;
+    AsyncSound bounce3;
+    AsyncSound shatter;
+  };
+  std::unique_ptr<Sounds> sounds;
 
   sf::Music* music_1;
   sf::Music* music_2;
 };
+
+//What drawing a frame needs from the Scene, copied out after every tick so a
+//render thread never reads the Scene while the simulation changes it
+struct SceneSnapshot {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  //Blends between the last two ticks, same as Scene::GetFrameUniforms
+  void GetFrameUniforms(SceneUniforms& u, float alpha=1.0f) const;
+
+  SceneUniforms   prev;
+  SceneUniforms   cur;
+  bool            snap;
+  Scene::CamMode  cam_mode;
+  int             level;
+  Eigen::Vector3f marble_pos;
+  sf::Vector3f    goal_direction;
+  int             countdown_time;
+  bool            high_score;
+  std::chrono::steady_clock::time_point time;  //When the tick was due
+};
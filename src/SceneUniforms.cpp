@@ -0,0 +1,65 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "SceneUniforms.h"
+
+static const float pi = 3.14159265359f;
+static const float start_cam_dist = 15.0f;   //Same as Scene's default zoom
+static const float start_cam_look_y = -0.3f;
+
+SceneUniforms SceneUniforms::Lerp(const SceneUniforms& a, const SceneUniforms& b, float t) {
+  SceneUniforms u = b;
+
+  //Camera rotation is interpolated as a rotation, position linearly
+  const Eigen::Quaternionf qa(a.cam_mat.block<3, 3>(0, 0));
+  const Eigen::Quaternionf qb(b.cam_mat.block<3, 3>(0, 0));
+  u.cam_mat.block<3, 3>(0, 0) = qa.slerp(t, qb).toRotationMatrix();
+  u.cam_mat.block<3, 1>(0, 3) = a.cam_mat.block<3, 1>(0, 3)*(1 - t) + b.cam_mat.block<3, 1>(0, 3)*t;
+
+  //Objects that appear, disappear or respawn jump much further than a marble rolls in a tick
+  const float max_jump = b.marble_rad * 10.0f;
+  if ((b.marble_pos - a.marble_pos).norm() < max_jump) {
+    u.marble_pos = a.marble_pos*(1 - t) + b.marble_pos*t;
+  }
+  if ((b.flag_pos - a.flag_pos).norm() < max_jump) {
+    u.flag_pos = a.flag_pos*(1 - t) + b.flag_pos*t;
+  }
+  u.exposure = a.exposure*(1 - t) + b.exposure*t;
+
+  //Angles can wrap by 2*pi between ticks, don't sweep through them
+  if ((b.frac_params - a.frac_params).cwiseAbs().maxCoeff() < pi) {
+    u.frac_params = a.frac_params*(1 - t) + b.frac_params*t;
+  }
+  return u;
+}
+
+SceneUniforms SceneUniforms::LevelStart(const Level& level) {
+  SceneUniforms u;
+  const Eigen::AngleAxisf aa_x(level.start_look_x, Eigen::Vector3f::UnitY());
+  const Eigen::AngleAxisf aa_y(start_cam_look_y, Eigen::Vector3f::UnitX());
+  const Eigen::Matrix3f rot = (aa_x * aa_y).toRotationMatrix();
+  u.cam_mat.setIdentity();
+  u.cam_mat.block<3, 3>(0, 0) = rot;
+  u.cam_mat.block<3, 1>(0, 3) = level.start_pos + rot * Eigen::Vector3f(0.0f, 0.0f, level.marble_rad * start_cam_dist) +
+                                Eigen::Vector3f::UnitY() * (level.marble_rad * start_cam_dist * 0.1f);
+  u.marble_pos = level.start_pos;
+  u.marble_rad = level.marble_rad;
+  u.flag_pos = level.end_pos;
+  u.flag_scale = level.planet ? -level.marble_rad : level.marble_rad;
+  u.frac_params = level.params;
+  u.exposure = 1.0f;
+  return u;
+}
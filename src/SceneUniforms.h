@@ -0,0 +1,40 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Level.h"
+#include <Eigen/Dense>
+
+//Everything Scene::Write sends to the fractal shader as plain data, so a
+//frame can be snapshotted and blended between two physics ticks.
+struct SceneUniforms {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Eigen::Matrix4f cam_mat;
+  Eigen::Vector3f marble_pos;
+  float           marble_rad;
+  Eigen::Vector3f flag_pos;
+  float           flag_scale;
+  FractalParams   frac_params;
+  float           exposure;
+
+  //Blend from a (t=0) to b (t=1)
+  static SceneUniforms Lerp(const SceneUniforms& a, const SceneUniforms& b, float t);
+
+  //The marble on a level's start from the default camera, a fixed view for
+  //comparing renderers. Planets are seen with the world's up, not the planet's.
+  static SceneUniforms LevelStart(const Level& level);
+};
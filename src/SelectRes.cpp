@@ -28,8 +28,7 @@ const Resolution all_resolutions[num_resolutions] = {
 };
 
 SelectRes::SelectRes(const sf::Font* _font) : font(_font), is_fullscreen(false) {
-  buff_hover.loadFromFile(menu_hover_wav);
-  sound_hover.setBuffer(buff_hover);
+  sound_hover.Load(menu_hover_wav);
 }
 
 int SelectRes::Select(const sf::Vector2i& mouse_pos) {
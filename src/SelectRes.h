@@ -17,6 +17,7 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include "AssetLoader.h"
 
 struct Resolution {
   Resolution(int w, int h, const char* i) : width(w), height(h), info(i) {}
@@ -43,6 +44,5 @@ private:
 
   bool is_fullscreen;
 
-  sf::Sound sound_hover;
-  sf::SoundBuffer buff_hover;
+  AsyncSound sound_hover;
 };
@@ -0,0 +1,77 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ShaderVariant.h"
+#include "Res.h"
+#include <set>
+#include <sstream>
+
+std::string ApplyShaderDefines(const std::string& src, const ShaderDefines& defines) {
+  std::istringstream sin(src);
+  std::string out;
+  std::string line;
+  std::set<std::string> replaced;
+  size_t version_end = 0;
+  while (std::getline(sin, line)) {
+    //Replace the value of defines that already exist
+    if (line.compare(0, 8, "#define ") == 0) {
+      const size_t name_end = line.find_first_of(" \t", 8);
+      const std::string name = line.substr(8, name_end - 8);
+      const ShaderDefines::const_iterator it = defines.find(name);
+      if (it != defines.end()) {
+        line = "#define " + name + " " + it->second;
+        replaced.insert(name);
+      }
+    }
+    out += line + "\n";
+    if (version_end == 0 && line.compare(0, 8, "#version") == 0) {
+      version_end = out.size();
+    }
+  }
+
+  //Anything else goes after #version, which must stay the first statement
+  std::string added;
+  for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it) {
+    if (replaced.count(it->first) == 0) {
+      added += "#define " + it->first + " " + it->second + "\n";
+    }
+  }
+  out.insert(version_end, added);
+  return out;
+}
+
+bool LoadShaderVariant(sf::Shader& shader, const char* vert_file, const char* frag_file, const ShaderDefines& defines,
+                       const char* version) {
+  std::string vert_src;
+  std::string frag_src;
+  if (!ReadRes(vert_file, vert_src) || !ReadRes(frag_file, frag_src)) {
+    return false;
+  }
+  if (version) {
+    const size_t start = frag_src.find("#version");
+    if (start == std::string::npos) {
+      return false;
+    }
+    const size_t end = frag_src.find('\n', start);
+    frag_src.replace(start, end - start, std::string("#version ") + version);
+  }
+  return shader.loadFromMemory(vert_src, ApplyShaderDefines(frag_src, defines));
+}
+
+bool LoadShaderRes(sf::Shader& shader, const char* name, sf::Shader::Type type) {
+  std::string src;
+  return ReadRes(name, src) && shader.loadFromMemory(src, type);
+}
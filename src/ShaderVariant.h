@@ -0,0 +1,37 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <string>
+
+//Compile-time switches for a shader, by name
+typedef std::map<std::string, std::string> ShaderDefines;
+
+//Rewrites shader source so every define in defines has the given value. A
+//matching "#define NAME ..." line has its value replaced, other names are
+//added right after the #version line.
+std::string ApplyShaderDefines(const std::string& src, const ShaderDefines& defines);
+
+//Loads a vertex and fragment shader pair, with defines applied to the fragment
+//shader. The same file can be compiled into several variants this way. A
+//version replaces the fragment shader's own #version if given.
+bool LoadShaderVariant(sf::Shader& shader, const char* vert_file, const char* frag_file, const ShaderDefines& defines,
+                       const char* version = nullptr);
+
+//Loads one stage from the asset pack, or from its loose file without a pack
+bool LoadShaderRes(sf::Shader& shader, const char* name, sf::Shader::Type type);
@@ -0,0 +1,83 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "SimThread.h"
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+SimThread::SimThread(Scene& _scene, float tick_rate, float _max_lag, const Tick& _tick) :
+  scene(_scene),
+  tick(_tick),
+  tick_time(1.0f / tick_rate),
+  max_lag(_max_lag),
+  quit(false) {
+}
+
+SimThread::~SimThread() {
+  Stop();
+}
+
+void SimThread::Start() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    scene.BeginTick();
+    scene.GetSnapshot(snapshots.GetBack());
+  }
+  snapshots.GetBack().time = Clock::now();
+  snapshots.Publish();
+  snapshots.Update();
+
+  quit = false;
+  thread = std::thread(&SimThread::Run, this);
+}
+
+void SimThread::Stop() {
+  quit = true;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+float SimThread::GetAlpha() const {
+  const float t = std::chrono::duration<float>(Clock::now() - GetSnapshot().time).count() / tick_time;
+  return std::min(std::max(t, 0.0f), 1.0f);
+}
+
+void SimThread::Run() {
+  const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(tick_time));
+  const Clock::duration lag = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(max_lag));
+  Clock::time_point next = Clock::now() + period;
+  while (!quit) {
+    //Rendering blends between ticks, so a plain sleep is precise enough here
+    std::this_thread::sleep_until(next);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      scene.BeginTick();
+      tick();
+      scene.GetSnapshot(snapshots.GetBack());
+    }
+    snapshots.GetBack().time = next;
+    snapshots.Publish();
+
+    //Ticks that are late run back to back until they catch up
+    next += period;
+    const Clock::time_point now = Clock::now();
+    if (now - next > lag) {
+      next = now;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Scene.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Runs the simulation on its own thread at a fixed tick rate, so physics and
+//input keep their pace however long frames take to draw. After every tick
+//the Scene is copied into a snapshot, and the render thread only ever reads
+//the newest one. Anything else that touches the Scene, or the game state the
+//ticks read, has to hold GetMutex() while doing so.
+class SimThread {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  typedef std::function<void()> Tick;
+
+  //Calls tick tick_rate times per second. After falling more than max_lag
+  //seconds behind it drops the time instead of catching up.
+  SimThread(Scene& scene, float tick_rate, float max_lag, const Tick& tick);
+  ~SimThread();
+
+  //Publishes the current state, then starts ticking
+  void Start();
+  void Stop();
+
+  std::mutex& GetMutex() { return mutex; }
+
+  //Swaps in the newest snapshot, call once per frame before reading it
+  void Update() { snapshots.Update(); }
+  const SceneSnapshot& GetSnapshot() const { return snapshots.GetFront(); }
+
+  //How far into the tick after the snapshot's the present is, from 0 to 1
+  float GetAlpha() const;
+
+protected:
+  void Run();
+
+private:
+  Scene&                      scene;
+  Tick                        tick;
+  float                       tick_time;
+  float                       max_lag;
+  TripleBuffer<SceneSnapshot> snapshots;
+  std::mutex                  mutex;
+  std::thread                 thread;
+  std::atomic<bool>           quit;
+};
@@ -0,0 +1,104 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "TemporalAA.h"
+#include "Res.h"
+#include "ShaderVariant.h"
+
+//Low discrepancy sequence in [-0.5, 0.5) so any few frames cover the pixel evenly
+static float Halton(int i, int base) {
+  float f = 1.0f;
+  float r = 0.0f;
+  while (i > 0) {
+    f /= float(base);
+    r += f * float(i % base);
+    i /= base;
+  }
+  return r - 0.5f;
+}
+
+TemporalAA::TemporalAA() :
+  prev_mat(Eigen::Matrix4f::Identity()),
+  prev_params(FractalParams::Zero()),
+  max_width(1),
+  max_height(1),
+  prev_width(0),
+  prev_height(0),
+  cur_history(0),
+  frame_num(0),
+  has_history(false),
+  enabled(true) {
+}
+
+bool TemporalAA::Create(unsigned int _max_width, unsigned int _max_height, const sf::ContextSettings& settings) {
+  if (!LoadShaderRes(resolve, taa_glsl, sf::Shader::Fragment)) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (!history[i].create(_max_width, _max_height, settings)) {
+      return false;
+    }
+    history[i].setSmooth(true);
+  }
+  max_width = _max_width;
+  max_height = _max_height;
+  has_history = false;
+  return true;
+}
+
+sf::Vector2f TemporalAA::GetJitter() const {
+  const int i = frame_num % taa_jitter_len + 1;
+  return sf::Vector2f(Halton(i, 2), Halton(i, 3));
+}
+
+const sf::Texture& TemporalAA::Resolve(const sf::Texture& current, unsigned int width, unsigned int height, const SceneUniforms& frame) {
+  //History is useless after a resize, and an animated fractal moves under it
+  const bool valid = has_history &&
+    width == prev_width && height == prev_height &&
+    frame.frac_params == prev_params;
+
+  //Resolve into the bottom left corner, same as the fractal was rendered
+  const sf::Vector2f size((float)width, (float)height);
+  sf::RenderTexture& target = history[cur_history];
+  sf::View view(sf::FloatRect(0.0f, 0.0f, size.x, size.y));
+  view.setViewport(sf::FloatRect(0.0f, 1.0f - size.y / float(max_height),
+                                 size.x / float(max_width), size.y / float(max_height)));
+  target.setView(view);
+
+  resolve.setUniform("iCurrent", current);
+  resolve.setUniform("iHistory", history[1 - cur_history].getTexture());
+  resolve.setUniform("iTextureSize", sf::Glsl::Vec2((float)max_width, (float)max_height));
+  resolve.setUniform("iResolution", size);
+  resolve.setUniform("iMat", sf::Glsl::Mat4(frame.cam_mat.data()));
+  resolve.setUniform("iPrevMat", sf::Glsl::Mat4(prev_mat.data()));
+  resolve.setUniform("iHistoryWeight", valid ? taa_history_weight : 0.0f);
+
+  //Alpha holds depth, so it must be copied and not blended
+  sf::RectangleShape rect(size);
+  sf::RenderStates states(&resolve);
+  states.blendMode = sf::BlendNone;
+  target.draw(rect, states);
+  target.display();
+
+  prev_mat = frame.cam_mat;
+  prev_params = frame.frac_params;
+  prev_width = width;
+  prev_height = height;
+  has_history = true;
+  frame_num += 1;
+  cur_history = 1 - cur_history;
+  return target.getTexture();
+}
@@ -0,0 +1,62 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "SceneUniforms.h"
+#include <SFML/Graphics.hpp>
+#include <Eigen/Dense>
+
+static const int taa_jitter_len = 8;          //Frames before the subpixel jitter pattern repeats
+static const float taa_history_weight = 0.9f; //Fraction of the reprojected history kept each frame
+
+//Antialiasing from one jittered sample per pixel per frame. Every frame is
+//blended with the previous result, reprojected through the old and new camera
+//using the hit distance the fractal shader stores in alpha. History is thrown
+//away where the previous frame saw a different surface, and clamped to the
+//colors around each pixel so lighting changes don't leave trails.
+class TemporalAA {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  TemporalAA();
+
+  //Allocates the history at the largest size that will ever be resolved
+  bool Create(unsigned int max_width, unsigned int max_height, const sf::ContextSettings& settings);
+
+  void SetEnabled(bool enable) { enabled = enable; has_history = false; }
+  bool IsEnabled() const { return enabled; }
+
+  //Subpixel offset the next frame should be rendered with
+  sf::Vector2f GetJitter() const;
+
+  //Blends the frame in the bottom left width x height corner of current into
+  //the history. Returns the texture holding the result in the same corner.
+  const sf::Texture& Resolve(const sf::Texture& current, unsigned int width, unsigned int height, const SceneUniforms& frame);
+
+private:
+  sf::RenderTexture history[2];
+  sf::Shader        resolve;
+  Eigen::Matrix4f   prev_mat;
+  FractalParams     prev_params;
+  unsigned int      max_width;
+  unsigned int      max_height;
+  unsigned int      prev_width;
+  unsigned int      prev_height;
+  int               cur_history;
+  int               frame_num;
+  bool              has_history;
+  bool              enabled;
+};
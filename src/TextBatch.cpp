@@ -0,0 +1,147 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "TextBatch.h"
+#include <cstdlib>
+
+//Same padding sf::Text puts around each glyph to avoid clipping smooth edges
+static const float glyph_padding = 1.0f;
+
+void TextBatch::Clear() {
+  //Keep the pages so their vertex storage is reused by the next rebuild
+  for (size_t i = 0; i < pages.size(); ++i) {
+    pages[i].vertices.clear();
+  }
+  dirty = false;
+}
+
+void TextBatch::Add(const sf::Text& text) {
+  const sf::Font* font = text.getFont();
+  if (!font || text.getString().getSize() == 0) {
+    return;
+  }
+  sf::VertexArray& vertices = GetPage(font->getTexture(text.getCharacterSize()));
+  if (text.getOutlineThickness() != 0.0f) {
+    AddGlyphs(text, vertices, true);
+  }
+  AddGlyphs(text, vertices, false);
+}
+
+void TextBatch::Add(const sf::Sprite& sprite) {
+  const sf::Texture* texture = sprite.getTexture();
+  if (!texture) {
+    return;
+  }
+  const sf::IntRect& rect = sprite.getTextureRect();
+  const sf::FloatRect pos(0.0f, 0.0f, float(std::abs(rect.width)), float(std::abs(rect.height)));
+  const sf::FloatRect uv(float(rect.left), float(rect.top), float(rect.width), float(rect.height));
+  AddQuad(GetPage(*texture), sprite.getTransform(), sprite.getColor(), pos, uv);
+}
+
+void TextBatch::Draw(sf::RenderTarget& target) const {
+  for (size_t i = 0; i < pages.size(); ++i) {
+    if (pages[i].vertices.getVertexCount() > 0) {
+      target.draw(pages[i].vertices, sf::RenderStates(pages[i].texture));
+    }
+  }
+}
+
+sf::VertexArray& TextBatch::GetPage(const sf::Texture& texture) {
+  for (size_t i = 0; i < pages.size(); ++i) {
+    if (pages[i].texture == &texture) {
+      return pages[i].vertices;
+    }
+  }
+  Page page;
+  page.texture = &texture;
+  page.vertices.setPrimitiveType(sf::Triangles);
+  pages.push_back(page);
+  return pages.back().vertices;
+}
+
+void TextBatch::AddGlyphs(const sf::Text& text, sf::VertexArray& vertices, bool outline) {
+  const sf::Font& font = *text.getFont();
+  const sf::String& str = text.getString();
+  const sf::Transform& transform = text.getTransform();
+  const unsigned int size = text.getCharacterSize();
+  const bool bold = (text.getStyle() & sf::Text::Bold) != 0;
+  const float thickness = (outline ? text.getOutlineThickness() : 0.0f);
+  const sf::Color color = (outline ? text.getOutlineColor() : text.getFillColor());
+
+  //Spacing rules match sf::Text so hover bounds still line up with the glyphs
+  float whitespace_width = font.getGlyph(L' ', size, bold).advance;
+  const float letter_spacing = (whitespace_width / 3.0f) * (text.getLetterSpacing() - 1.0f);
+  whitespace_width += letter_spacing;
+  const float line_spacing = font.getLineSpacing(size) * text.getLineSpacing();
+
+  float x = 0.0f;
+  float y = float(size);
+  sf::Uint32 prev_char = 0;
+  for (size_t i = 0; i < str.getSize(); ++i) {
+    const sf::Uint32 cur_char = str[i];
+    if (cur_char == L'\r') {
+      continue;
+    }
+    x += font.getKerning(prev_char, cur_char, size);
+    prev_char = cur_char;
+
+    if (cur_char == L' ') {
+      x += whitespace_width;
+      continue;
+    } else if (cur_char == L'\t') {
+      x += whitespace_width * 4.0f;
+      continue;
+    } else if (cur_char == L'\n') {
+      y += line_spacing;
+      x = 0.0f;
+      continue;
+    }
+
+    //Quad in text space and in texture pixels
+    const sf::Glyph& glyph = font.getGlyph(cur_char, size, bold, thickness);
+    const sf::FloatRect pos(
+      x + glyph.bounds.left - glyph_padding,
+      y + glyph.bounds.top - glyph_padding,
+      glyph.bounds.width + 2.0f * glyph_padding,
+      glyph.bounds.height + 2.0f * glyph_padding);
+    const sf::FloatRect uv(
+      float(glyph.textureRect.left) - glyph_padding,
+      float(glyph.textureRect.top) - glyph_padding,
+      float(glyph.textureRect.width) + 2.0f * glyph_padding,
+      float(glyph.textureRect.height) + 2.0f * glyph_padding);
+    AddQuad(vertices, transform, color, pos, uv);
+
+    //Advance with the fill glyph even in the outline pass, like sf::Text
+    x += font.getGlyph(cur_char, size, bold).advance + letter_spacing;
+  }
+}
+
+void TextBatch::AddQuad(sf::VertexArray& vertices, const sf::Transform& transform, const sf::Color& color, const sf::FloatRect& pos, const sf::FloatRect& uv) {
+  const float right = pos.left + pos.width;
+  const float bottom = pos.top + pos.height;
+  const float u2 = uv.left + uv.width;
+  const float v2 = uv.top + uv.height;
+  const sf::Vertex tl(transform.transformPoint(pos.left, pos.top), color, sf::Vector2f(uv.left, uv.top));
+  const sf::Vertex tr(transform.transformPoint(right, pos.top), color, sf::Vector2f(u2, uv.top));
+  const sf::Vertex bl(transform.transformPoint(pos.left, bottom), color, sf::Vector2f(uv.left, v2));
+  const sf::Vertex br(transform.transformPoint(right, bottom), color, sf::Vector2f(u2, v2));
+  vertices.append(tl);
+  vertices.append(tr);
+  vertices.append(bl);
+  vertices.append(bl);
+  vertices.append(tr);
+  vertices.append(br);
+}
@@ -0,0 +1,53 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+//Glyphs of many sf::Text objects packed into one vertex array per font page,
+//so a whole screen of static text is a handful of draw calls. Sprites go in
+//the same way, one array per texture. The geometry is
+//built the same way sf::Text builds it (outline first, then fill) and is only
+//rebuilt after Invalidate(), not every frame.
+class TextBatch {
+public:
+  TextBatch() : dirty(true) {}
+
+  void Invalidate() { dirty = true; }
+  bool IsDirty() const { return dirty; }
+
+  //Drops all glyphs and marks the batch as up to date
+  void Clear();
+
+  //Appends the text with its current string, style and transform
+  void Add(const sf::Text& text);
+  void Add(const sf::Sprite& sprite);
+
+  void Draw(sf::RenderTarget& target) const;
+
+private:
+  struct Page {
+    const sf::Texture* texture;
+    sf::VertexArray    vertices;
+  };
+  sf::VertexArray& GetPage(const sf::Texture& texture);
+  void AddGlyphs(const sf::Text& text, sf::VertexArray& vertices, bool outline);
+  static void AddQuad(sf::VertexArray& vertices, const sf::Transform& transform, const sf::Color& color, const sf::FloatRect& pos, const sf::FloatRect& uv);
+
+  std::vector<Page> pages;
+  bool              dirty;
+};
@@ -0,0 +1,54 @@
+/* This file is part of the Marble Marcher (https://github.com/HackerPoet/MarbleMarcher).
+* Copyright(C) 2018 CodeParade
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <atomic>
+
+//Hands the newest value from one writer thread to one reader thread without
+//locks. The writer fills the back buffer and publishes it, the reader swaps
+//in whatever was published last. Neither ever waits for the other, and values
+//the reader was too slow to see are simply skipped.
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() : back(0), middle(1), front(2) {}
+
+  //Writer side
+  T& GetBack() { return buffers[back]; }
+  void Publish() {
+    back = middle.exchange(back | fresh_bit, std::memory_order_acq_rel) & index_mask;
+  }
+
+  //Reader side, returns true if a newer value was swapped in
+  bool Update() {
+    if ((middle.load(std::memory_order_relaxed) & fresh_bit) == 0) {
+      return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+    return true;
+  }
+  const T& GetFront() const { return buffers[front]; }
+
+private:
+  //The middle index carries a flag for whether the reader has seen it yet
+  static const int index_mask = 3;
+  static const int fresh_bit = 4;
+
+  T                buffers[3];
+  int              back;
+  std::atomic<int> middle;
+  int              front;
+};